@@ -0,0 +1,84 @@
+#include "AudioScope.hpp"
+
+#include "Sound.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+AudioScope::AudioScope() : fft(Window) {
+	waveform.assign(Window, 0.0f);
+	spectrum.fill(Floor);
+
+	hann.resize(Window);
+	for (uint32_t i = 0; i < Window; ++i) {
+		hann[i] = 0.5f - 0.5f * std::cos(2.0f * 3.14159265358979f * float(i) / float(Window));
+	}
+
+	//log-spaced band edges, at least one bin per band:
+	// (the lowest bands are narrower than a bin, so they get pushed up a little)
+	float const bin_hz = 48000.0f / float(Window);
+	for (uint32_t b = 0; b <= Bands; ++b) {
+		float hz = 20.0f * std::pow(1000.0f, float(b) / float(Bands));
+		uint32_t bin = std::max(1u, uint32_t(std::round(hz / bin_hz)));
+		if (b > 0) bin = std::max(bin, band_edges[b-1] + 1);
+		band_edges[b] = std::min(bin, fft.bins());
+	}
+
+	windowed.resize(Window);
+	re.resize(fft.bins());
+	im.resize(fft.bins());
+}
+
+void AudioScope::update(float elapsed) {
+	incoming.clear();
+	uint32_t frames = Sound::read_tap(&incoming);
+
+	float hold_scale = std::pow(10.0f, -hold_fall * elapsed / 20.0f);
+	for (auto &meter : meters) {
+		meter.peak_hold *= hold_scale;
+	}
+	for (auto &level : spectrum) {
+		level = std::max(Floor, level - spectrum_fall * elapsed);
+	}
+	if (frames == 0) return;
+
+	//meters:
+	for (uint32_t c = 0; c < 2; ++c) {
+		float sum = 0.0f;
+		float peak = 0.0f;
+		for (uint32_t s = 0; s < frames; ++s) {
+			float v = incoming[2*s+c];
+			sum += v * v;
+			peak = std::max(peak, std::abs(v));
+		}
+		Meter &meter = meters[c];
+		meter.rms = std::sqrt(sum / float(frames));
+		meter.peak = peak;
+		meter.peak_hold = std::max(meter.peak_hold, peak);
+	}
+
+	//waveform -- slide the newest frames in at the end:
+	uint32_t keep = (frames < Window ? Window - frames : 0);
+	std::copy(waveform.end() - keep, waveform.end(), waveform.begin());
+	uint32_t first = frames - (Window - keep); //(skip frames that would just scroll off again)
+	for (uint32_t s = first; s < frames; ++s) {
+		waveform[keep + (s - first)] = 0.5f * (incoming[2*s+0] + incoming[2*s+1]);
+	}
+
+	//spectrum:
+	for (uint32_t i = 0; i < Window; ++i) {
+		windowed[i] = waveform[i] * hann[i];
+	}
+	fft.forward(windowed.data(), re.data(), im.data());
+
+	//a full-scale sine comes out with magnitude Window / 4 (Window / 2, halved by the Hann window):
+	float const full_scale = float(Window) / 4.0f;
+	for (uint32_t b = 0; b < Bands; ++b) {
+		float power = 0.0f;
+		for (uint32_t k = band_edges[b]; k < band_edges[b+1]; ++k) {
+			power = std::max(power, re[k] * re[k] + im[k] * im[k]);
+		}
+		float db = 10.0f * std::log10(std::max(power, 1e-20f)) - 20.0f * std::log10(full_scale);
+		spectrum[b] = std::max(spectrum[b], std::max(Floor, db));
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+ * An AudioScope reads the mixer's output tap (see Sound::set_tap / Sound::read_tap)
+ *  on the game thread and keeps the things an overlay wants to draw:
+ *   - the most recent Window frames of (mono) output, for an oscilloscope;
+ *   - a spectrum in Bands log-spaced bands from 20Hz to 20kHz, in dB relative
+ *     to a full-scale sine (Hann-windowed FFT of the same frames);
+ *   - per-channel RMS and peak meters, with a falling peak hold.
+ *
+ * Call update() once per frame while the tap is on. Reading the tap never
+ *  makes the audio callback wait; if update() isn't called often enough, the
+ *  callback drops blocks instead (counted in Sound::Stats::tap_dropped).
+ */
+
+#include "fft.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct AudioScope {
+	//frames in the oscilloscope view and the FFT window (about 43ms at 48kHz):
+	static constexpr uint32_t const Window = 2048;
+	//spectrum bands:
+	static constexpr uint32_t const Bands = 48;
+	//lowest level reported (dB):
+	static constexpr float const Floor = -90.0f;
+
+	AudioScope();
+
+	//read whatever the tap has and update the waveform, spectrum, and meters:
+	void update(float elapsed);
+
+	//most recent Window frames of (left + right) / 2, oldest first:
+	std::vector< float > waveform;
+
+	//level of each band in dB (Floor to about 0), falling at most 'spectrum_fall' dB per second:
+	std::array< float, Bands > spectrum;
+	float spectrum_fall = 30.0f;
+
+	struct Meter {
+		float rms = 0.0f; //over the frames read by the last update() that read any
+		float peak = 0.0f; //...largest absolute value
+		float peak_hold = 0.0f; //largest recent peak, falling at 'hold_fall' dB per second
+	};
+	std::array< Meter, 2 > meters; //left, right
+	float hold_fall = 20.0f;
+
+	//-- internals ---
+
+	RealFFT fft;
+	std::vector< float > hann; //window function
+	std::array< uint32_t, Bands + 1 > band_edges; //band b is bins [band_edges[b], band_edges[b+1])
+	std::vector< float > incoming; //interleaved frames read from the tap
+	std::vector< float > windowed, re, im; //FFT scratch
+};
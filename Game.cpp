@@ -1,7 +1,114 @@
 #include "Game.hpp"
 
+#include "KeywordSpotter.hpp"
+#include "Load.hpp"
+#include "SoundBank.hpp"
+#include "render_sequence.hpp"
+#include "time_stretch.hpp"
+
+#include <chrono>
+#include <iostream>
+
 namespace Game {
 
+namespace {
+
+// Letter clips come out of the packed bank (built by build-bank from dist/sounds) when it is there,
+// which skips decoding entirely; without it, each clip is decoded from its .opus file:
+std::unique_ptr<SoundBank> bank;
+Load<void> load_bank(LoadTagEarly, []() {
+    try {
+        bank = std::make_unique<SoundBank>(data_path("sounds.bank"));
+    } catch (std::exception const &e) {
+        std::cerr << "WARNING: " << e.what() << " Decoding letter clips from .opus files instead." << std::endl;
+    }
+}, LoadOnMainThread, "sounds.bank");
+
+// The clip cache, with every letter clip (and its hard mode version) and word registered:
+struct ClipCache : SampleCache {
+    ClipCache() : SampleCache(CLIP_CACHE_BUDGET) {
+        for (const auto& p : SOUND_PATHS) {
+            std::string path = p.second;
+            add(clip_name(p.first, false), [path]() {
+                if (bank) {
+                    // bank names are file names without directory or extension:
+                    std::string name = path.substr(path.find_last_of('/') + 1);
+                    name = name.substr(0, name.rfind('.'));
+                    return bank->lookup(name);
+                }
+                return Sound::Sample(data_path(path));
+            });
+            // hard mode clips are the normal ones, time-stretched:
+            char c = p.first;
+            add(clip_name(c, true), [c]() {
+                return time_stretch(clip_cache().get(clip_name(c, false)), HARD_SPEED);
+            });
+        }
+        // words are their letter clips, rendered back-to-back (or with gaps) into a single clip:
+        for (uint32_t w = 0; w < WORD_LIST_SIZE; ++w) {
+            for (bool hard : {false, true}) {
+                for (bool gaps : {false, true}) {
+                    if (hard && gaps) continue; //(hard mode never has gaps)
+                    add(word_name(w, hard, gaps), [w, hard, gaps]() {
+                        std::vector<Sound::Sample> clips;
+                        for (char c : WORD_LIST[w]) {
+                            clips.emplace_back(clip_cache().get(clip_name(c, hard)));
+                        }
+                        std::vector<Sound::SequenceItem> items(clips.size());
+                        for (size_t i = 0; i < clips.size(); ++i) {
+                            items[i].sample = &clips[i];
+                            items[i].gap = (gaps ? EASY_WORD_GAP : 0.f);
+                        }
+                        return render_sequence(items, WORD_CROSSFADE);
+                    });
+                }
+            }
+        }
+    }
+};
+
+// Warms the cache with every letter clip at load time, one any-thread loader per clip, so the clips
+// decode in parallel and get() doesn't have to decode one on the main thread later:
+// (hard mode clips and words are prefetched on a worker ahead of use -- see prefetch_word_audio)
+struct ClipWarmup {
+    ClipWarmup() {
+        for (const auto& p : SOUND_PATHS) {
+            char c = p.first;
+            add_load_function(LoadTagDefault, [c]() {
+                clip_cache().prefetch(clip_name(c, false));
+            }, LoadOnAnyThread, p.second);
+        }
+    }
+};
+ClipWarmup clip_warmup;
+
+}
+
+std::string clip_name(char c, bool hard) {
+    return (hard ? "hard/" : "") + std::string(1, c);
+}
+
+std::string word_name(uint32_t word, bool hard, bool gaps) {
+    return "word/" + std::to_string(word) + (hard ? "/hard" : "") + (gaps ? "/gaps" : "");
+}
+
+SampleCache &clip_cache() {
+    static ClipCache cache;
+    return cache;
+}
+
+void add_letter_templates(KeywordSpotter *spotter) {
+    assert(spotter);
+    std::vector<float> data;
+    for (const auto& p : SOUND_PATHS) {
+        Sound::Sample clip = clip_cache().get(clip_name(p.first, false));
+        data.resize(clip.size());
+        clip.decode(0, clip.size(), data.data());
+        spotter->add_template(p.first, data);
+    }
+}
+
+
 uint32_t Game::current_selected() {
     return match_order[current_word_matched];
 }
@@ -19,65 +126,89 @@ void Game::mark_incorrect() {
 
 void Game::begin_playing_word_audio() {
     capture_input = false; 
-    current_audio_letter = 0;
+    word_audio = Sound::PlayingSample();
 }
 
 void Game::play_intro_audio() {
-    current = Sound::play(intro_audio); 
+    current = Sound::play(intro_audio, 1.0f, 0.0f, Sound::SFXBus); 
+}
+
+void Game::prefetch_word_audio() {
+    if (current_word >= WORD_LIST_SIZE || (prefetched_word == current_word && prefetched_hard == hard)) {
+        return;
+    }
+    // (replacing an unfinished std::async future would wait for it, so let the old one finish first)
+    if (word_prefetch.valid() && word_prefetch.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
+    prefetched_word = current_word;
+    prefetched_hard = hard;
+    // Loading the word's clips and rendering the word take a moment, so do it while the transition audio plays:
+    // (easy mode words play with gaps the first time, and without for replays)
+    uint32_t word = current_word;
+    bool word_hard = hard;
+    word_prefetch = std::async(std::launch::async, [word, word_hard]() {
+        clip_cache().prefetch(word_name(word, word_hard, !word_hard));
+        if (!word_hard) {
+            clip_cache().prefetch(word_name(word, word_hard, false));
+        }
+    });
 }
 
 bool Game::play_transition_audio() {
     assert(!capture_input); 
-    if (current != nullptr) {
-        if (current->stopped) {
-            current = nullptr;
+    if (current) {
+        if (current_finished) {
+            current = Sound::PlayingSample();
             return true;
         } 
     }
     else {
-        current = Sound::play(transition_audio);
+        current = Sound::play(transition_audio, 1.0f, 0.0f, Sound::SFXBus);
+        current_finished = false;
+        Sound::PlayingSample playing = current;
+        current.on_finished([this, playing]() {
+            if (current == playing) current_finished = true;
+        });
     }
     return false;
 }
 
 
-void Game::play_word_audio(float elapsed) {
-    uint32_t len = static_cast<uint32_t>(WORD_LIST[current_word].length());
-    if (current != nullptr) {
-        if (current->stopped) {
-            ++current_audio_letter; 
-            current = nullptr;
+void Game::play_word_audio() {
+    if (!word_audio) {
+        // Wait (without blocking the frame) for the word to be rendered, so it doesn't hitch:
+        prefetch_word_audio();
+        if (prefetched_word != current_word || prefetched_hard != hard) {
+            return; //(an earlier prefetch is still finishing)
         }
-    }
-    else {
-        if (hard) {
-            Sound::Sample& s = hard_audio.find(WORD_LIST[current_word][current_audio_letter])->second;
-            current = Sound::play(s);
-        }
-        else {
-            if (state == Word) {
-                // For easy mode, add a slight delay between sounds
-                // ONLY FOR INITIAL, REPLAYS DONT GET
-                if (time_passed < 0.5f) {
-                    time_passed += elapsed;
-                    return; 
-                }
-                time_passed = 0.f;
+        if (word_prefetch.valid()) {
+            if (word_prefetch.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return;
             }
-            Sound::Sample& s = audio.find(WORD_LIST[current_word][current_audio_letter])->second;
-            current = Sound::play(s);
+            word_prefetch.get(); //(passes along any loading errors)
         }
+        // The whole word is one clip, so the letters (and gaps) are timed exactly by the mixer:
+        // For easy mode, add a slight delay between sounds
+        // ONLY FOR INITIAL, REPLAYS DONT GET
+        bool gaps = (!hard && state == Word);
+        word_audio = Sound::play(clip_cache().get(word_name(current_word, hard, gaps)), 1.0f, 0.0f, Sound::VoiceBus);
+        word_audio_finished = false;
+        Sound::PlayingSample playing = word_audio;
+        word_audio.on_finished([this, playing]() {
+            if (word_audio == playing) word_audio_finished = true;
+        });
+        return;
     }
-    if (current_audio_letter == len) {
-        if (state == Word) {
-            begin_word_capture();
-            current_audio_letter = 0;
-        }
-        else if (state == Capture) {
-            current_audio_letter = 0;
-            replay = false; 
-            current = nullptr;
-        }
+    if (!word_audio_finished) {
+        return;
+    }
+    word_audio = Sound::PlayingSample();
+    if (state == Word) {
+        begin_word_capture();
+    }
+    else if (state == Capture) {
+        replay = false; 
     }
 }
 
@@ -118,9 +249,13 @@ bool Game::word_matched() {
 }
 
 bool Game::next_word() {
-    if (current != nullptr) {
-       current->stop(); 
-       current = nullptr;
+    if (current) {
+       current.stop(); 
+       current = Sound::PlayingSample();
+    }
+    if (word_audio) {
+        word_audio.stop();
+        word_audio = Sound::PlayingSample();
     }
     score += time_passed;
     time_passed = 0.f;
@@ -129,6 +264,8 @@ bool Game::next_word() {
     match_order.clear();
     ++current_word; 
     state = Transition;
+    // Start loading the next word's clips now, so they are ready when the transition audio ends:
+    prefetch_word_audio();
     if (current_word == WORD_LIST_SIZE) {
         game_over = true;
         score += static_cast<float>(replays) * 10.f;
@@ -2,6 +2,7 @@
 
 #include "Scene.hpp"
 #include "Sound.hpp"
+#include "SampleCache.hpp"
 #include "data_path.hpp"
 
 #include <stdint.h>
@@ -9,8 +10,11 @@
 #include <array>
 #include <unordered_map>
 #include <memory>
+#include <future>
 #include <cassert>
 
+struct KeywordSpotter; //(see KeywordSpotter.hpp)
+
 namespace Game {
 
 constexpr uint32_t WORD_LIST_SIZE = 5;
@@ -58,44 +62,14 @@ constexpr std::array<std::pair<char, const char *>, NUM_SOUNDS> SOUND_PATHS = {
     std::pair('y', "sounds/y.opus"),
     std::pair('z', "sounds/z.opus")
 };
-constexpr std::array<std::pair<char, const char *>, NUM_SOUNDS> HARD_SOUND_PATHS = {
-    std::pair('1', "sounds/12.opus"),
-    std::pair('2', "sounds/22.opus"),
-    std::pair('3', "sounds/32.opus"),
-    std::pair('4', "sounds/42.opus"),
-    std::pair('5', "sounds/52.opus"),
-    std::pair('6', "sounds/62.opus"),
-    std::pair('7', "sounds/72.opus"),
-    std::pair('8', "sounds/82.opus"),
-    std::pair('9', "sounds/92.opus"),
-    std::pair('0', "sounds/02.opus"),
-    std::pair('a', "sounds/a2.opus"),
-    std::pair('b', "sounds/b2.opus"),
-    std::pair('c', "sounds/c2.opus"),
-    std::pair('d', "sounds/d2.opus"),
-    std::pair('e', "sounds/e2.opus"),
-    std::pair('f', "sounds/f2.opus"),
-    std::pair('g', "sounds/g2.opus"),
-    std::pair('h', "sounds/h2.opus"),
-    std::pair('i', "sounds/i2.opus"),
-    std::pair('j', "sounds/j2.opus"),
-    std::pair('k', "sounds/k2.opus"),
-    std::pair('l', "sounds/l2.opus"),
-    std::pair('m', "sounds/m2.opus"),
-    std::pair('n', "sounds/n2.opus"),
-    std::pair('o', "sounds/o2.opus"),
-    std::pair('p', "sounds/p2.opus"),
-    std::pair('q', "sounds/q2.opus"),
-    std::pair('r', "sounds/r2.opus"),
-    std::pair('s', "sounds/s2.opus"),
-    std::pair('t', "sounds/t2.opus"),
-    std::pair('u', "sounds/u2.opus"),
-    std::pair('v', "sounds/v2.opus"),
-    std::pair('w', "sounds/w2.opus"),
-    std::pair('x', "sounds/x2.opus"),
-    std::pair('y', "sounds/y2.opus"),
-    std::pair('z', "sounds/z2.opus")
-};
+// Hard mode plays the same clips, time-stretched (pitch unchanged) to be this many times faster:
+constexpr float HARD_SPEED = 3.5f;
+// Letter clips (normal and hard) and rendered words are loaded on demand, and at most this many bytes of them stay loaded:
+constexpr size_t CLIP_CACHE_BUDGET = 8 * 1024 * 1024;
+// Words are rendered into one clip each (see render_sequence), with letters joined by this long a crossfade:
+constexpr float WORD_CROSSFADE = 0.005f;
+// and, the first time an easy mode word is played, this long a gap before each letter:
+constexpr float EASY_WORD_GAP = 0.5f;
 
 const std::string INTRO_AUDIO_PATH = "sounds/intro.opus";
 const std::string TRANSITION_AUDIO_PATH = "sounds/transition.opus";
@@ -131,6 +105,16 @@ struct Word {
         std::string word;
 };
 
+// Letter clips (SOUND_PATHS, and their hard mode versions), and each WORD_LIST entry rendered from them,
+// loaded the first time they are used. Look them up by clip_name() and word_name():
+SampleCache &clip_cache();
+std::string clip_name(char c, bool hard);
+std::string word_name(uint32_t word, bool hard, bool gaps);
+
+// Spoken answers (see SpeechInput) are matched against the letter clips themselves;
+// this adds a template for each SOUND_PATHS clip to 'spotter' (decoding them, so it takes a moment):
+void add_letter_templates(KeywordSpotter *spotter);
+
 enum AudioState {
     Transition,
     Word,
@@ -146,8 +130,6 @@ struct Game {
              transition_audio(data_path(TRANSITION_AUDIO_PATH)) {
         current_word = 0;
         current_word_matched = 0;
-        current_audio_letter = 0;
-        current = nullptr;
         hard = true;
         capture_input = true;
         game_over = false;
@@ -156,16 +138,6 @@ struct Game {
         replay = false;
         mistakes = 0;
         replays = 0;
-        // Load all audio samples
-        for (const auto& p : SOUND_PATHS) {
-            assert(audio.find(p.first) == audio.end());
-            audio.emplace(p.first, Sound::Sample(data_path(std::string(p.second))));
-        } 
-        // Load all hard mode audio samples
-        for (const auto& p : HARD_SOUND_PATHS) {
-            assert(hard_audio.find(p.first) == hard_audio.end());
-            hard_audio.emplace(p.first, Sound::Sample(data_path(std::string(p.second))));
-        } 
         time_passed = 0.f;
         score = 0.f;
         state = Intro;
@@ -186,8 +158,9 @@ struct Game {
     uint32_t current_selected();
     void begin_playing_word_audio();
     void play_intro_audio();
+    void prefetch_word_audio();
     bool play_transition_audio();
-    void play_word_audio(float elapsed);
+    void play_word_audio();
     void begin_word_capture();
     void mark_incorrect();
     void mark_correct();
@@ -195,17 +168,25 @@ struct Game {
     bool match_letter(char c);
     bool word_matched();
     bool next_word();
-    std::shared_ptr<Sound::PlayingSample> current; 
+    Sound::PlayingSample current; 
+    // The current word, played (as one clip) by play_word_audio():
+    Sound::PlayingSample word_audio;
+    // Set (by on_finished callbacks, from Sound::poll_events) when 'current' / 'word_audio' finish:
+    bool current_finished = false;
+    bool word_audio_finished = false;
     std::vector<Letter> letters;
     
 
     private:
-        Sound::Sample intro_audio; 
-        Sound::Sample transition_audio;
-        std::unordered_map<char, Sound::Sample> audio;
-        std::unordered_map<char, Sound::Sample> hard_audio;
+        // intro and transition clips are long, so they're streamed rather than decoded up front:
+        Sound::StreamingSample intro_audio; 
+        Sound::StreamingSample transition_audio;
+        // The current word's clips are loaded (and stretched, for hard mode) on a worker thread by
+        // prefetch_word_audio() while the transition audio plays:
+        std::future<void> word_prefetch;
+        uint32_t prefetched_word = ~0u;
+        bool prefetched_hard = false;
         std::vector<uint32_t> match_order;
-        uint32_t current_audio_letter;
         uint32_t current_word_matched;
         uint32_t current_word; 
 };
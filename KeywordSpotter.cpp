@@ -0,0 +1,283 @@
+#include "KeywordSpotter.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	float hz_to_mel(float hz) { return 2595.0f * std::log10(1.0f + hz / 700.0f); }
+	float mel_to_hz(float mel) { return 700.0f * (std::pow(10.0f, mel / 2595.0f) - 1.0f); }
+}
+
+KeywordSpotter::KeywordSpotter() : fft(FFTSize) {
+	constexpr float const Pi = 3.14159265358979f;
+
+	window.resize(Frame);
+	for (uint32_t i = 0; i < Frame; ++i) {
+		window[i] = 0.54f - 0.46f * std::cos(2.0f * Pi * float(i) / float(Frame - 1));
+	}
+
+	//triangular filters, evenly spaced in mel from 50Hz to 8kHz (where the speech is):
+	float const low = hz_to_mel(50.0f);
+	float const high = hz_to_mel(8000.0f);
+	float const bin_hz = float(Rate) / float(FFTSize);
+	for (uint32_t b = 0; b < MelBands; ++b) {
+		float left = mel_to_hz(low + (high - low) * float(b) / float(MelBands + 1)) / bin_hz;
+		float center = mel_to_hz(low + (high - low) * float(b + 1) / float(MelBands + 1)) / bin_hz;
+		float right = mel_to_hz(low + (high - low) * float(b + 2) / float(MelBands + 1)) / bin_hz;
+		MelFilter &filter = mel[b];
+		filter.begin = uint32_t(std::ceil(left));
+		for (uint32_t k = filter.begin; float(k) < right; ++k) {
+			float w = (float(k) < center ? (float(k) - left) / (center - left) : (right - float(k)) / (right - center));
+			filter.weights.emplace_back(std::max(0.0f, w));
+		}
+		if (filter.weights.empty()) {
+			//(can't happen with these sizes, but a filter narrower than a bin should still see something)
+			filter.begin = uint32_t(std::round(center));
+			filter.weights.emplace_back(1.0f);
+		}
+	}
+
+	//DCT-II rows 1 .. Coefficients:
+	for (uint32_t c = 0; c < Coefficients; ++c) {
+		for (uint32_t b = 0; b < MelBands; ++b) {
+			dct[c][b] = std::cos(Pi * float(c + 1) * (float(b) + 0.5f) / float(MelBands));
+		}
+	}
+
+	padded.assign(FFTSize, 0.0f);
+	re.resize(fft.bins());
+	im.resize(fft.bins());
+}
+
+void KeywordSpotter::analyze(float const *frame, Features *features, float *db) {
+	assert(features);
+	assert(db);
+
+	float energy = 0.0f;
+	for (uint32_t i = 0; i < Frame; ++i) {
+		energy += frame[i] * frame[i];
+	}
+	*db = 10.0f * std::log10(energy / float(Frame) + 1e-12f);
+
+	//pre-emphasis (lifts the high end, where consonants are) and window:
+	padded[0] = frame[0] * window[0];
+	for (uint32_t i = 1; i < Frame; ++i) {
+		padded[i] = (frame[i] - 0.97f * frame[i-1]) * window[i];
+	}
+	//(padded[Frame ..] stays zero)
+
+	fft.forward(padded.data(), re.data(), im.data());
+
+	std::array< float, MelBands > log_mel;
+	for (uint32_t b = 0; b < MelBands; ++b) {
+		MelFilter const &filter = mel[b];
+		float sum = 0.0f;
+		for (uint32_t k = 0; k < filter.weights.size(); ++k) {
+			uint32_t bin = filter.begin + k;
+			sum += filter.weights[k] * (re[bin] * re[bin] + im[bin] * im[bin]);
+		}
+		log_mel[b] = std::log(sum + 1e-10f);
+	}
+
+	for (uint32_t c = 0; c < Coefficients; ++c) {
+		float sum = 0.0f;
+		for (uint32_t b = 0; b < MelBands; ++b) {
+			sum += dct[c][b] * log_mel[b];
+		}
+		(*features)[c] = sum;
+	}
+}
+
+void KeywordSpotter::add_template(char letter, std::vector< float > const &samples) {
+	//analyze every frame (zero-padding the end, so short clips still get a frame):
+	std::vector< float > data = samples;
+	data.resize(std::max< size_t >(data.size(), Frame) + Frame, 0.0f);
+	std::vector< Features > frames;
+	std::vector< float > dbs;
+	for (size_t begin = 0; begin + Frame <= data.size(); begin += Hop) {
+		Features features;
+		float db;
+		analyze(data.data() + begin, &features, &db);
+		frames.emplace_back(features);
+		dbs.emplace_back(db);
+	}
+
+	//keep the frames from the first to the last one within 30dB of the loudest:
+	float loudest = *std::max_element(dbs.begin(), dbs.end());
+	if (loudest < min_speech_db) {
+		throw std::runtime_error("Template for '" + std::string(1, letter) + "' is too quiet to use.");
+	}
+	size_t first = 0;
+	while (dbs[first] < loudest - 30.0f) ++first;
+	size_t last = dbs.size() - 1;
+	while (dbs[last] < loudest - 30.0f) --last;
+
+	Template added;
+	added.letter = letter;
+	added.frames.assign(frames.begin() + first, frames.begin() + last + 1);
+	templates.emplace_back(std::move(added));
+}
+
+void KeywordSpotter::feed(float const *samples, size_t count) {
+	auto before = std::chrono::steady_clock::now();
+
+	pending.insert(pending.end(), samples, samples + count);
+	samples_fed += count;
+
+	size_t begin = 0;
+	for (; begin + Frame <= pending.size(); begin += Hop) {
+		step(pending.data() + begin, pending_start + begin);
+	}
+	pending.erase(pending.begin(), pending.begin() + begin);
+	pending_start += begin;
+
+	busy_seconds += std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+}
+
+void KeywordSpotter::step(float const *frame, uint64_t position) {
+	Features features;
+	float db;
+	analyze(frame, &features, &db);
+	++frames_analyzed;
+
+	//the noise floor is the quietest recent frame -- it follows steady background noise up or down
+	// within 'noise_frames' frames, but a word (which is shorter than that) doesn't lift it:
+	// (a few hundred comparisons per frame is nothing next to the FFT)
+	if (recent_db.size() != noise_frames) {
+		recent_db.assign(std::max(1u, noise_frames), db);
+		recent_next = 0;
+	}
+	recent_db[recent_next] = db;
+	recent_next = (recent_next + 1) % uint32_t(recent_db.size());
+	noise_db = *std::min_element(recent_db.begin(), recent_db.end());
+	float start_threshold = std::max(noise_db + start_db, min_speech_db);
+	float stop_threshold = std::max(noise_db + stop_db, min_speech_db - (start_db - stop_db));
+
+	if (!in_utterance) {
+		if (db > start_threshold) {
+			if (loud_run == 0) {
+				utterance.clear();
+				utterance_start = position;
+			}
+			utterance.emplace_back(features);
+			++loud_run;
+			if (loud_run >= start_frames) {
+				in_utterance = true;
+				quiet_run = 0;
+			}
+		} else {
+			loud_run = 0;
+			utterance.clear();
+		}
+		return;
+	}
+
+	utterance.emplace_back(features);
+	if (db < stop_threshold) {
+		++quiet_run;
+	} else {
+		quiet_run = 0;
+	}
+	if (quiet_run >= hangover_frames) {
+		utterance.resize(utterance.size() - quiet_run); //(the trailing quiet isn't part of the word)
+		finish_utterance(position + Frame);
+	} else if (utterance.size() >= max_frames) {
+		finish_utterance(position + Frame);
+	}
+}
+
+void KeywordSpotter::flush() {
+	auto before = std::chrono::steady_clock::now();
+	if (in_utterance) {
+		utterance.resize(utterance.size() - quiet_run);
+		finish_utterance(samples_fed);
+	}
+	loud_run = 0;
+	utterance.clear();
+	busy_seconds += std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+}
+
+void KeywordSpotter::finish_utterance(uint64_t decided_sample) {
+	if (utterance.size() >= min_frames && !templates.empty()) {
+		Result result;
+		result.distance = 1e30f;
+		for (auto const &t : templates) {
+			float distance = dtw(utterance, t.frames, &scratch);
+			if (distance < result.distance) {
+				result.distance = distance;
+				result.letter = t.letter;
+			}
+		}
+		if (!(result.distance <= reject_distance)) result.letter = '\0';
+		result.begin_sample = utterance_start;
+		result.end_sample = utterance_start + (utterance.size() - 1) * Hop + Frame;
+		result.decided_sample = decided_sample;
+		results.emplace_back(result);
+	}
+
+	in_utterance = false;
+	loud_run = 0;
+	quiet_run = 0;
+	utterance.clear();
+}
+
+bool KeywordSpotter::poll(Result *result) {
+	assert(result);
+	if (results_read == results.size()) {
+		results.clear();
+		results_read = 0;
+		return false;
+	}
+	*result = results[results_read++];
+	return true;
+}
+
+float KeywordSpotter::dtw(std::vector< Features > const &a, std::vector< Features > const &b, std::vector< float > *scratch) {
+	assert(scratch);
+	constexpr float const Far = 1e30f;
+	uint32_t n = uint32_t(a.size());
+	uint32_t m = uint32_t(b.size());
+	if (n == 0 || m == 0) return Far;
+	//the same word said at very different speeds is more likely a different word:
+	if (std::max(n, m) > 3 * std::min(n, m)) return Far;
+
+	//only cells within 'reach' of the (stretched) diagonal are considered (a Sakoe-Chiba band),
+	// which keeps the cost near linear and stops paths from warping absurdly:
+	float reach = 0.25f * float(std::max(n, m)) + 1.0f;
+
+	scratch->assign(2 * m, Far);
+	float *prev = scratch->data();
+	float *cur = prev + m;
+	for (uint32_t i = 0; i < n; ++i) {
+		float center = (n == 1 ? 0.0f : float(i) * float(m - 1) / float(n - 1));
+		uint32_t lo = uint32_t(std::max(0.0f, std::ceil(center - reach)));
+		uint32_t hi = uint32_t(std::min(float(m - 1), std::floor(center + reach)));
+		std::fill(cur, cur + m, Far);
+		for (uint32_t j = lo; j <= hi; ++j) {
+			float sum = 0.0f;
+			for (uint32_t c = 0; c < Coefficients; ++c) {
+				float diff = a[i][c] - b[j][c];
+				sum += diff * diff;
+			}
+			float d = std::sqrt(sum);
+
+			//symmetric steps (diagonal steps count twice), so every path's weights add up to n + m:
+			float best;
+			if (i == 0 && j == 0) {
+				best = 2.0f * d;
+			} else {
+				best = Far;
+				if (i > 0) best = std::min(best, prev[j] + d);
+				if (j > 0) best = std::min(best, cur[j-1] + d);
+				if (i > 0 && j > 0) best = std::min(best, prev[j-1] + 2.0f * d);
+			}
+			cur[j] = best;
+		}
+		std::swap(prev, cur);
+	}
+	return prev[m - 1] / float(n + m);
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+/*
+ * A KeywordSpotter listens to a stream of 48kHz mono audio for short spoken
+ *  words (here, letters and digits) and reports which template each one
+ *  sounds most like.
+ *
+ * The pipeline runs a little at a time, as audio arrives (see feed()):
+ *  - framing: Frame-sample frames every Hop samples, pre-emphasized and Hamming-windowed;
+ *  - features: MFCCs (RealFFT power spectrum -> mel filterbank -> log -> DCT);
+ *  - endpointing: frames well above the noise floor (the quietest frame of the
+ *    last 'noise_frames' frames) start an utterance, and 'hangover_frames' quiet
+ *    frames in a row end it;
+ *  - matching: each finished utterance is compared against every template with
+ *    dynamic time warping (DTW) over MFCCs; the closest wins.
+ *    (MFCCs are compared as they are: subtracting each utterance's mean would be
+ *    more robust to microphone coloring, but would also flatten single-vowel
+ *    letters like 'e' and 'o' into each other.)
+ *
+ * So a decision comes at most (hangover_frames * Hop + Frame) samples after the
+ *  speaker stops (about a quarter second with the defaults), and utterances are
+ *  cut off at 'max_frames' frames, which bounds the matching work per decision.
+ *
+ * Templates are recordings of each word (e.g., the game's letter clips; see
+ *  Game::add_letter_templates), trimmed to their loud part when added.
+ *
+ * Everything runs on the caller's thread; SpeechInput feeds it from a microphone
+ *  or from WAV files.
+ */
+
+#include "fft.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct KeywordSpotter {
+	static constexpr uint32_t const Rate = 48000;
+	static constexpr uint32_t const Frame = 1200; //25ms analysis frames...
+	static constexpr uint32_t const Hop = 480; //...every 10ms
+	static constexpr uint32_t const FFTSize = 2048; //(frames are zero-padded to this)
+	static constexpr uint32_t const MelBands = 26;
+	static constexpr uint32_t const Coefficients = 12; //MFCCs 1 .. 12 (loudness is left to the endpointing)
+	typedef std::array< float, Coefficients > Features;
+
+	KeywordSpotter();
+
+	//add a template for 'letter' from a recording of it (48kHz mono):
+	// (any number of templates per letter; the quiet parts at either end are trimmed off)
+	// note: will throw if there isn't anything loud enough in 'samples' to use.
+	void add_template(char letter, std::vector< float > const &samples);
+
+	//run the pipeline over the next 'count' samples of the stream:
+	void feed(float const *samples, size_t count);
+
+	//decide on any utterance still in progress (e.g., at the end of a file):
+	void flush();
+
+	struct Result {
+		char letter = '\0'; //closest template, or '\0' if even that was farther than 'reject_distance'
+		float distance = 0.0f; //DTW distance (mean per-frame distance along the warping path)
+		uint64_t begin_sample = 0; //where the utterance started in the stream
+		uint64_t end_sample = 0; //...and where it ended
+		uint64_t decided_sample = 0; //how far into the stream the spotter had read when it decided
+	};
+	//get the next decision, if there is one:
+	bool poll(Result *result);
+
+	//tuning:
+	float start_db = 15.0f; //frames this far above the noise floor are speech...
+	float stop_db = 8.0f; //...and speech ends when frames stay under this far above it
+	float min_speech_db = -55.0f; //(but never quieter than this, so near-silence isn't speech)
+	uint32_t start_frames = 3; //consecutive loud frames to start an utterance
+	uint32_t hangover_frames = 20; //consecutive quiet frames to end one
+	uint32_t min_frames = 8; //utterances shorter than this are ignored (clicks, bumps)
+	uint32_t max_frames = 150; //utterances are cut off (and decided) at this length
+	uint32_t noise_frames = 150; //the noise floor is the quietest frame in this many (longer than any word)
+	float reject_distance = 1e30f; //results farther than this from every template aren't recognized
+
+	//counters (for checking the pipeline keeps up):
+	uint64_t samples_fed = 0;
+	uint64_t frames_analyzed = 0;
+	double busy_seconds = 0.0; //time spent in feed() and flush()
+
+	//-- internals ---
+
+	//compute the features and loudness (dB relative to full scale) of one frame:
+	void analyze(float const *frame, Features *features, float *db);
+
+	//run one frame (starting at stream position 'position') through features and endpointing:
+	void step(float const *frame, uint64_t position);
+
+	//decide on the current utterance (if it is long enough) and start over:
+	void finish_utterance(uint64_t decided_sample);
+
+	struct Template {
+		char letter;
+		std::vector< Features > frames;
+	};
+	std::vector< Template > templates;
+
+	//DTW distance between two feature sequences:
+	// (returns a huge value if their lengths are too different to be the same word)
+	static float dtw(std::vector< Features > const &a, std::vector< Features > const &b, std::vector< float > *scratch);
+
+	RealFFT fft;
+	std::vector< float > window; //Hamming, Frame samples
+	struct MelFilter {
+		uint32_t begin = 0; //first bin
+		std::vector< float > weights; //triangular weights for bins begin, begin + 1, ...
+	};
+	std::array< MelFilter, MelBands > mel;
+	std::array< std::array< float, MelBands >, Coefficients > dct;
+	std::vector< float > padded, re, im, scratch; //analysis / DTW scratch
+
+	std::vector< float > pending; //stream samples not yet consumed by a hop
+	uint64_t pending_start = 0; //stream position of pending[0]
+
+	std::vector< float > recent_db; //loudness of the last 'noise_frames' frames (circular)
+	uint32_t recent_next = 0; //where the next frame's loudness goes in recent_db
+	float noise_db = 0.0f; //noise floor (minimum of recent_db)
+	uint32_t loud_run = 0; //consecutive loud frames (while not in an utterance)
+	uint32_t quiet_run = 0; //consecutive quiet frames (while in an utterance)
+	bool in_utterance = false;
+	std::vector< Features > utterance; //features of the frames in the current utterance (or of the recent loud run)
+	uint64_t utterance_start = 0;
+
+	std::vector< Result > results; //decisions not yet polled
+	size_t results_read = 0;
+};
@@ -1,20 +1,47 @@
 #include "Load.hpp"
 
+#include <algorithm>
 #include <array>
-#include <list>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
+	struct LoadFunction {
+		std::function< void() > fn;
+		LoadThread thread = LoadOnMainThread;
+		std::string name;
+		float seconds = 0.0f; //filled in by call_load_functions
+	};
+
+	std::array< std::list< LoadFunction >, MaxLoadTag > &get_load_lists() {
+		static std::array< std::list< LoadFunction >, MaxLoadTag > load_lists;
 		return load_lists;
 	}
+
+	//helper: run a load function and record how long it took:
+	void timed_call(LoadFunction &lf) {
+		auto before = std::chrono::high_resolution_clock::now();
+		lf.fn();
+		auto after = std::chrono::high_resolution_clock::now();
+		lf.seconds = std::chrono::duration< float >(after - before).count();
+	}
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
+void add_load_function(LoadTag tag, std::function< void() > const &fn, LoadThread thread, std::string const &name) {
 	auto &load_lists = get_load_lists();
 	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	load_lists[tag].emplace_back();
+	load_lists[tag].back().fn = fn;
+	load_lists[tag].back().thread = thread;
+	load_lists[tag].back().name = name;
 }
 
 void call_load_functions() {
@@ -22,11 +49,98 @@ void call_load_functions() {
 	assert(!has_been_called && "call_load_functions should only be called *once*");
 	has_been_called = true;
 
+	auto start = std::chrono::high_resolution_clock::now();
+
+	//main thread + (up to) hardware_concurrency - 1 workers:
+	uint32_t workers = std::max(1U, std::thread::hardware_concurrency()) - 1;
+
+	std::vector< LoadFunction > done; //for the report
+	std::array< float, MaxLoadTag > tag_seconds;
+	tag_seconds.fill(0.0f);
+
 	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	for (uint32_t tag = 0; tag < MaxLoadTag; ++tag) {
+		auto tag_start = std::chrono::high_resolution_clock::now();
+
+		//split this tag's functions by where they may run:
+		std::vector< LoadFunction > main_fns;
+		std::vector< LoadFunction > any_fns;
+		for (auto &lf : load_lists[tag]) {
+			(lf.thread == LoadOnMainThread ? main_fns : any_fns).emplace_back(std::move(lf));
+		}
+		load_lists[tag].clear();
+
+		//any-thread functions are handed out (in order) to whichever thread is free:
+		std::atomic< uint32_t > next_any(0);
+		std::mutex error_mutex;
+		std::exception_ptr error;
+		auto run_any = [&]() {
+			for (;;) {
+				uint32_t i = next_any.fetch_add(1);
+				if (i >= any_fns.size()) break;
+				try {
+					timed_call(any_fns[i]);
+				} catch (...) {
+					std::lock_guard< std::mutex > lock(error_mutex);
+					if (!error) error = std::current_exception();
+					next_any.store(uint32_t(any_fns.size())); //skip the rest
+				}
+			}
+		};
+
+		std::vector< std::thread > threads;
+		for (uint32_t w = 0; w < workers && w < any_fns.size(); ++w) {
+			threads.emplace_back(run_any);
+		}
+
+		//main-thread functions run in order while the workers decode:
+		try {
+			for (auto &lf : main_fns) {
+				timed_call(lf);
+			}
+		} catch (...) {
+			std::lock_guard< std::mutex > lock(error_mutex);
+			if (!error) error = std::current_exception();
+			next_any.store(uint32_t(any_fns.size())); //tell workers to stop
+		}
+
+		//...then the main thread helps out with whatever is left:
+		run_any();
+
+		//tags are barriers -- everything in this tag finishes before the next starts:
+		for (auto &thread : threads) {
+			thread.join();
+		}
+		if (error) std::rethrow_exception(error);
+
+		auto tag_end = std::chrono::high_resolution_clock::now();
+		tag_seconds[tag] = std::chrono::duration< float >(tag_end - tag_start).count();
+
+		for (auto &lf : main_fns) done.emplace_back(std::move(lf));
+		for (auto &lf : any_fns) done.emplace_back(std::move(lf));
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	{ //report load times:
+		float total = std::chrono::duration< float >(end - start).count();
+		float busy = 0.0f;
+		for (auto const &lf : done) busy += lf.seconds;
+
+		std::cout << "Loaded " << done.size() << " items in " << std::fixed << std::setprecision(1) << total * 1000.0f << " ms"
+		          << " (" << busy * 1000.0f << " ms of loading work, " << (workers + 1) << " threads)." << std::endl;
+		std::cout << "  by tag: early " << tag_seconds[LoadTagEarly] * 1000.0f << " ms, default " << tag_seconds[LoadTagDefault] * 1000.0f
+		          << " ms, late " << tag_seconds[LoadTagLate] * 1000.0f << " ms" << std::endl;
+
+		std::stable_sort(done.begin(), done.end(), [](LoadFunction const &a, LoadFunction const &b) {
+			return a.seconds > b.seconds;
+		});
+		for (auto const &lf : done) {
+			std::cout << "  " << std::setw(8) << lf.seconds * 1000.0f << " ms  "
+			          << (lf.thread == LoadOnMainThread ? "[main] " : "[any]  ")
+			          << (lf.name.empty() ? "(unnamed)" : lf.name) << std::endl;
 		}
+		std::cout.unsetf(std::ios::floatfield);
+		std::cout << std::setprecision(6);
 	}
 }
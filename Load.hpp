@@ -20,10 +20,17 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Functions that only do CPU work (reading files, decoding audio or images, parsing chunks)
+ * can be added with LoadOnAnyThread, in which case they are run on a pool of worker threads
+ * alongside the main-thread functions with the same tag. Functions that touch OpenGL must
+ * stay on the main thread (the default).
+ * Every function with a given tag finishes before any function with a later tag starts.
+ *
  */
 
 #include <functional>
 #include <stdexcept>
+#include <string>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
@@ -32,11 +39,17 @@ enum LoadTag : uint32_t {
 	MaxLoadTag //<-- just used to track # of load tags
 };
 
+enum LoadThread : uint32_t {
+	LoadOnMainThread, //function needs the OpenGL context; run it on the thread calling call_load_functions()
+	LoadOnAnyThread //function is CPU-only; may run on a worker thread
+};
+
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+// 'name' is used in the load time report.
+void add_load_function(LoadTag tag, std::function< void() > const &fn, LoadThread thread = LoadOnMainThread, std::string const &name = "");
 
-//Call all loading functions:
+//Call all loading functions, then print a report of how long they took:
 // (loading functions may throw exceptions if they fail.)
 // (only call *once*)
 void call_load_functions();
@@ -49,13 +62,13 @@ T const *new_T() { return new T; }
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
+	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >, LoadThread thread = LoadOnMainThread, std::string const &name = "") : value(nullptr) {
 		add_load_function(tag, [this,load_fn](){
 			this->value = load_fn();
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
-		});
+		}, thread, name);
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
@@ -73,8 +86,8 @@ struct Load {
 template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+	Load( LoadTag tag, const std::function< void() > &load_fn, LoadThread thread = LoadOnMainThread, std::string const &name = "") {
+		add_load_function(tag, load_fn, thread, name);
 	}
 };
 
@@ -127,7 +127,43 @@ const game_names = [
 	maek.CPP('main.cpp'),
 	maek.CPP('LitColorTextureProgram.cpp'),
 	//maek.CPP('ColorTextureProgram.cpp'),  //not used right now, but you might want it
+];
+
+//sample encodings (used by the audio system and by build-bank):
+const encoding_names = [
+	maek.CPP('adpcm.cpp'),
+	maek.CPP('mix_kernels.cpp')
+];
+
+//the FFT is shared between the audio system and speech input:
+const fft_names = [
+	maek.CPP('fft.cpp')
+];
+
+//the audio system is shared between the game and the mixer benchmark:
+const sound_names = [
 	maek.CPP('Sound.cpp'),
+	...encoding_names,
+	maek.CPP('opus_stream.cpp'),
+	maek.CPP('mix_workers.cpp'),
+	...fft_names,
+	maek.CPP('hrtf.cpp'),
+	maek.CPP('AudioScope.cpp'),
+	maek.CPP('bus_effects.cpp'),
+	maek.CPP('SoundBank.cpp'),
+	maek.CPP('SampleCache.cpp'),
+	maek.CPP('time_stretch.cpp'),
+	maek.CPP('render_sequence.cpp')
+];
+
+//speech input (spoken answers) is shared between the game and the keyword spotting tool:
+const speech_names = [
+	maek.CPP('KeywordSpotter.cpp'),
+	maek.CPP('SpeechInput.cpp')
+];
+
+//audio decoding is shared between the game and the sound bank builder:
+const audio_names = [
 	maek.CPP('load_wav.cpp'),
 	maek.CPP('load_opus.cpp')
 ];
@@ -163,12 +199,25 @@ const show_scene_names = [
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
-const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
+const game_exe = maek.LINK([...game_names, ...sound_names, ...speech_names, ...audio_names, ...common_names], 'dist/game');
+const build_bank_exe = maek.LINK([maek.CPP('build-bank.cpp'), ...encoding_names, ...audio_names], 'scenes/build-bank');
+const bench_sound_exe = maek.LINK([maek.CPP('bench-sound.cpp'), ...sound_names, ...audio_names], 'scenes/bench-sound');
+const spot_keywords_exe = maek.LINK([maek.CPP('spot-keywords.cpp'), ...speech_names, ...fft_names, ...encoding_names, ...audio_names], 'scenes/spot-keywords');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
 
+//pack the letter clips into one memory-mappable bank (intro and transition are streamed, so they stay separate):
+const bank_sounds = require('fs').readdirSync('dist/sounds')
+	.filter(name => name.endsWith('.opus') && name !== 'intro.opus' && name !== 'transition.opus')
+	.sort()
+	.map(name => `dist/sounds/${name}`);
+const sound_bank = 'dist/sounds.bank';
+maek.RULE([sound_bank], [build_bank_exe, ...bank_sounds], [
+	[build_bank_exe, sound_bank, ...bank_sounds]
+]);
+
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, bench_sound_exe, spot_keywords_exe, sound_bank, ...copies];
 
 //the '[targets =] RULE(targets, prerequisites[, recipe])' rule defines a Makefile-style task
 // targets: array of targets the task produces (can include both files and ':abstract targets')
@@ -179,6 +228,15 @@ maek.RULE([':run'], [game_exe], [
 	[game_exe, '--some-command-line-option']
 ]);
 
+//run the (headless) mixer benchmark with a few standard mixes:
+// (e.g., `node Maekfile.js :bench-sound` and compare against a previous run)
+maek.RULE([':bench-sound'], [bench_sound_exe], [
+	[bench_sound_exe, '--voices', '64', '--seconds', '10', '--mix', '2d'],
+	[bench_sound_exe, '--voices', '64', '--seconds', '10', '--mix', '3d'],
+	[bench_sound_exe, '--voices', '64', '--seconds', '10', '--mix', 'all'],
+	[bench_sound_exe, '--voices', '64', '--seconds', '10', '--mix', 'binaural']
+]);
+
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
 
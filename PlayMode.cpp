@@ -10,6 +10,12 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
 #include <random>
 
 PlayMode::PlayMode() {
@@ -21,6 +27,32 @@ PlayMode::~PlayMode() {
 }
 
 bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
+	if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F3) {
+		show_audio_stats = !show_audio_stats;
+		return true;
+	}
+	if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F4) {
+		show_audio_scope = !show_audio_scope;
+		Sound::set_tap(show_audio_scope);
+		return true;
+	}
+	if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F5) {
+		speech_wanted = !speech_wanted;
+		if (!speech_wanted) {
+			speech.reset();
+		} else if (letter_templates) {
+			start_listening();
+		} else if (!building_templates.valid()) {
+			//decoding and analyzing every letter clip would stall the game for a while, so do it on a worker:
+			building_templates = std::async(std::launch::async, []() {
+				auto spotter = std::make_unique< KeywordSpotter >();
+				Game::add_letter_templates(spotter.get());
+				return spotter;
+			});
+		}
+		heard = '\0';
+		return true;
+	}
 	if (!game.capture_input || game.game_over) {
 		return false;	
 	}
@@ -32,9 +64,9 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 				game.state = Game::Transition;
 				game.time_passed = 0.f;
 				game.capture_input = false;
-				if (game.current != nullptr) {
-					game.current->stop();
-					game.current = nullptr;	
+				if (game.current) {
+					game.current.stop();
+					game.current = Sound::PlayingSample();	
 				}
 				return true;
 			}
@@ -43,9 +75,9 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 				game.state = Game::Transition;	
 				game.time_passed = 0.f;
 				game.capture_input = false;
-				if (game.current != nullptr) {
-					game.current->stop();
-					game.current = nullptr;	
+				if (game.current) {
+					game.current.stop();
+					game.current = Sound::PlayingSample();	
 				}
 				return true;
 			}
@@ -91,18 +123,7 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 			case SDLK_8:
 			case SDLK_9:
 			case SDLK_0:
-				if (game.match_letter(static_cast<char>(evt.key.keysym.sym))) {
-					game.mark_correct();
-					game.next_letter();
-					if (game.word_matched() && !game.next_word()) {
-						game.begin_playing_word_audio();
-					} 
-				}
-				else {
-					game.mark_incorrect();
-					// Each mistake, add one to the game score
-					game.mistakes += 1;
-				}
+				answer(static_cast<char>(evt.key.keysym.sym));
 				return true;
 			case SDLK_RETURN:
 				game.replay = true;	
@@ -113,23 +134,78 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 	return false;
 }
 
+void PlayMode::answer(char c) {
+	if (game.match_letter(c)) {
+		game.mark_correct();
+		game.next_letter();
+		if (game.word_matched() && !game.next_word()) {
+			game.begin_playing_word_audio();
+		} 
+	}
+	else {
+		game.mark_incorrect();
+		// Each mistake, add one to the game score
+		game.mistakes += 1;
+	}
+}
+
+void PlayMode::start_listening() {
+	assert(letter_templates);
+	try {
+		auto input = std::make_unique< SpeechInput >();
+		input->spotter = *letter_templates;
+		speech = std::move(input);
+	} catch (std::exception const &e) {
+		std::cerr << "Can't answer by speaking: " << e.what() << std::endl;
+		speech_wanted = false;
+	}
+}
+
 void PlayMode::update(float elapsed) {
+	//sounds that finished since last frame run their on_finished callbacks here:
+	Sound::poll_events();
+	Sound::update_latency();
+	if (show_audio_scope) audio_scope.update(elapsed);
+
+	if (building_templates.valid() && building_templates.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		try {
+			letter_templates = building_templates.get();
+			if (speech_wanted) start_listening();
+		} catch (std::exception const &e) {
+			std::cerr << "Can't answer by speaking: " << e.what() << std::endl;
+			speech_wanted = false;
+		}
+	}
+
+	//spoken letters are answers, just like typed ones (when typing would be accepted):
+	if (speech) {
+		speech->update(elapsed);
+		KeywordSpotter::Result result;
+		while (speech->spotter.poll(&result)) {
+			heard = result.letter;
+			if (result.letter && game.capture_input && !game.game_over && game.state != Game::Intro) {
+				answer(result.letter);
+			}
+		}
+	}
+
 	if (game.game_over) {
 		return;
 	}
 	switch(game.state) {
 		case Game::Transition:
+			game.prefetch_word_audio();
 			if (game.play_transition_audio()) {
 				game.time_passed = 0.f;	
 				game.state = Game::Word;
 			}
 			break;
 		case Game::Word:
-			game.play_word_audio(elapsed);
+			game.play_word_audio();
 			break;	
 		case Game::Capture:
 			if (game.replay) {
-				game.play_word_audio(elapsed);
+				game.play_word_audio();
 			}
 			for (auto& letter : game.letters) {
 				if (letter.incorrect) {
@@ -245,6 +321,123 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 					break;
 			}
 		}
+
+		if (show_audio_stats) {
+			Sound::Stats stats = Sound::stats();
+			char buf[128];
+			std::vector< std::string > rows;
+			snprintf(buf, sizeof(buf), "audio: %.2f ms last, %.2f mean, %.2f max of %.2f budget", stats.last_ms, stats.mean_ms, stats.max_ms, stats.budget_ms);
+			rows.emplace_back(buf);
+			snprintf(buf, sizeof(buf), "headroom %.2f ms min; %llu overruns in %llu blocks; %.2f ms max late", stats.min_headroom_ms, (unsigned long long)stats.overruns, (unsigned long long)stats.callbacks, stats.max_late_ms);
+			rows.emplace_back(buf);
+			snprintf(buf, sizeof(buf), "blocks of %u frames; %llu underruns", stats.block_frames, (unsigned long long)stats.underruns);
+			rows.emplace_back(buf);
+			if (stats.mixer_priority) {
+				snprintf(buf, sizeof(buf), "mixer thread at %s priority; %u frames queued; %llu KB locked", stats.mixer_priority, stats.queued_frames, (unsigned long long)(stats.locked_bytes / 1024));
+				rows.emplace_back(buf);
+			}
+			snprintf(buf, sizeof(buf), "voices %u (max %u) + %u virtual; lock wait %.2f ms max, %.2f ms total", stats.voices, stats.max_voices, stats.virtual_voices, stats.lock_wait_max_ms, stats.lock_wait_total_ms);
+			rows.emplace_back(buf);
+			std::string histogram = "budget used:";
+			for (uint32_t b = 0; b < Sound::Stats::Buckets; ++b) {
+				histogram += " " + std::to_string(stats.histogram[b]);
+			}
+			rows.emplace_back(histogram);
+
+			constexpr float stats_size = 0.05f;
+			for (uint32_t r = 0; r < rows.size(); ++r) {
+				lines.draw_text(rows[r],
+					glm::vec3(-aspect + 0.5f * stats_size, 1.0f - (r + 1.2f) * 1.2f * stats_size, 0.0),
+					glm::vec3(stats_size, 0.0f, 0.0f), glm::vec3(0.0f, stats_size, 0.0f),
+					glm::u8vec4(0xff, 0xff, 0x00, 0x00));
+			}
+		}
+
+		if (speech || (speech_wanted && building_templates.valid())) {
+			std::string status = (speech ? "listening (F5 to stop)" : "getting ready to listen...");
+			if (heard) status += "; heard '" + std::string(1, heard) + "'";
+			constexpr float speech_text_size = 0.05f;
+			lines.draw_text(status,
+				glm::vec3(-aspect + 0.05f, -0.3f, 0.0f),
+				glm::vec3(speech_text_size, 0.0f, 0.0f), glm::vec3(0.0f, speech_text_size, 0.0f),
+				glm::u8vec4(0xff, 0xff, 0x00, 0x00));
+		}
+
+		if (show_audio_scope) {
+			//levels are drawn on a -60dB .. 0dB scale:
+			auto level_height = [](float db) {
+				return std::max(0.0f, std::min(1.0f, (db + 60.0f) / 60.0f));
+			};
+			auto to_db = [](float amplitude) {
+				return 20.0f * std::log10(std::max(amplitude, 1e-6f));
+			};
+			glm::u8vec4 const frame_color(0x44, 0x44, 0x44, 0x00);
+			float const bottom = -0.95f;
+			float const height = 0.5f;
+
+			{ //oscilloscope, lower left:
+				float left_x = -aspect + 0.05f;
+				float right_x = -0.05f;
+				float mid_y = bottom + 0.5f * height;
+				lines.draw(glm::vec3(left_x, mid_y, 0.0f), glm::vec3(right_x, mid_y, 0.0f), frame_color);
+				std::vector< float > const &wave = audio_scope.waveform;
+				float step = (right_x - left_x) / float(wave.size() - 1);
+				for (uint32_t i = 1; i < wave.size(); ++i) {
+					lines.draw(
+						glm::vec3(left_x + (i - 1) * step, mid_y + 0.5f * height * std::max(-1.0f, std::min(1.0f, wave[i-1])), 0.0f),
+						glm::vec3(left_x + i * step, mid_y + 0.5f * height * std::max(-1.0f, std::min(1.0f, wave[i])), 0.0f),
+						glm::u8vec4(0x00, 0xff, 0x88, 0x00));
+				}
+			}
+
+			{ //spectrum bars, lower right (leaving room for the meters):
+				float left_x = 0.05f;
+				float right_x = aspect - 0.3f;
+				lines.draw(glm::vec3(left_x, bottom, 0.0f), glm::vec3(right_x, bottom, 0.0f), frame_color);
+				float width = (right_x - left_x) / float(AudioScope::Bands);
+				for (uint32_t b = 0; b < AudioScope::Bands; ++b) {
+					float x0 = left_x + (b + 0.15f) * width;
+					float x1 = left_x + (b + 0.85f) * width;
+					float y = bottom + height * level_height(audio_scope.spectrum[b]);
+					glm::u8vec4 color(0x44, 0xaa, 0xff, 0x00);
+					lines.draw(glm::vec3(x0, bottom, 0.0f), glm::vec3(x0, y, 0.0f), color);
+					lines.draw(glm::vec3(x0, y, 0.0f), glm::vec3(x1, y, 0.0f), color);
+					lines.draw(glm::vec3(x1, y, 0.0f), glm::vec3(x1, bottom, 0.0f), color);
+				}
+			}
+
+			//RMS / peak meters, far right (left then right channel):
+			for (uint32_t c = 0; c < 2; ++c) {
+				AudioScope::Meter const &meter = audio_scope.meters[c];
+				float x0 = aspect - 0.25f + c * 0.12f;
+				float x1 = x0 + 0.08f;
+				lines.draw_box(glm::mat4x3(
+					glm::vec3(0.5f * (x1 - x0), 0.0f, 0.0f),
+					glm::vec3(0.0f, 0.5f * height, 0.0f),
+					glm::vec3(0.0f, 0.0f, 0.0f),
+					glm::vec3(0.5f * (x0 + x1), bottom + 0.5f * height, 0.0f)
+				), frame_color);
+				float rms_y = bottom + height * level_height(to_db(meter.rms));
+				for (float y = bottom; y < rms_y; y += 0.01f) {
+					lines.draw(glm::vec3(x0, y, 0.0f), glm::vec3(x1, y, 0.0f), glm::u8vec4(0x00, 0xcc, 0x00, 0x00));
+				}
+				float peak_y = bottom + height * level_height(to_db(meter.peak));
+				lines.draw(glm::vec3(x0, peak_y, 0.0f), glm::vec3(x1, peak_y, 0.0f), glm::u8vec4(0xff, 0xff, 0x00, 0x00));
+				float hold_y = bottom + height * level_height(to_db(meter.peak_hold));
+				glm::u8vec4 hold_color = (meter.peak_hold >= 1.0f ? glm::u8vec4(0xff, 0x00, 0x00, 0x00) : glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+				lines.draw(glm::vec3(x0, hold_y, 0.0f), glm::vec3(x1, hold_y, 0.0f), hold_color);
+			}
+
+			char buf[128];
+			snprintf(buf, sizeof(buf), "peak %.1f / %.1f dB; %llu blocks dropped from tap",
+				to_db(audio_scope.meters[0].peak_hold), to_db(audio_scope.meters[1].peak_hold),
+				(unsigned long long)Sound::stats().tap_dropped);
+			constexpr float scope_text_size = 0.05f;
+			lines.draw_text(buf,
+				glm::vec3(-aspect + 0.05f, bottom + height + 0.5f * scope_text_size, 0.0f),
+				glm::vec3(scope_text_size, 0.0f, 0.0f), glm::vec3(0.0f, scope_text_size, 0.0f),
+				glm::u8vec4(0xff, 0xff, 0x00, 0x00));
+		}
 	}
 	GL_ERRORS();
 }
\ No newline at end of file
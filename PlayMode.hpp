@@ -3,11 +3,15 @@
 #include "Scene.hpp"
 #include "Sound.hpp"
 #include "Game.hpp"
+#include "AudioScope.hpp"
+#include "SpeechInput.hpp"
 
 #include <glm/glm.hpp>
 
 #include <vector>
 #include <deque>
+#include <future>
+#include <memory>
 
 struct PlayMode : Mode {
 	PlayMode();
@@ -18,6 +22,9 @@ struct PlayMode : Mode {
 	virtual void update(float elapsed) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
 
+	//check an answer (typed or spoken) against the current word:
+	void answer(char c);
+
 	//----- game state -----
 
 	//input tracking:
@@ -30,6 +37,23 @@ struct PlayMode : Mode {
 	// Game
 	Game::Game game;
 
+	//F3 toggles an overlay with audio callback timing (see Sound::stats()):
+	bool show_audio_stats = false;
+
+	//F4 toggles an oscilloscope / spectrum / level meter overlay of the mixed output (see AudioScope):
+	bool show_audio_scope = false;
+	AudioScope audio_scope;
+
+	//F5 toggles answering by saying letters into the microphone (see SpeechInput):
+	// (the letter templates take a while to build, so that happens on a worker the first time;
+	//  listening starts once they're ready)
+	bool speech_wanted = false;
+	std::future< std::unique_ptr< KeywordSpotter > > building_templates;
+	std::unique_ptr< KeywordSpotter > letter_templates; //(a spotter with the templates added, copied for each SpeechInput)
+	std::unique_ptr< SpeechInput > speech;
+	char heard = '\0'; //most recent letter recognized ('\0' if none, or not recognized)
+	void start_listening(); //(once 'letter_templates' is ready)
+
 	//camera:
 	Scene::Camera *camera = nullptr;
 
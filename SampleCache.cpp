@@ -0,0 +1,112 @@
+#include "SampleCache.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+SampleCache::SampleCache(size_t budget) : budget_bytes(budget) {
+}
+
+void SampleCache::add(std::string const &name, Loader const &loader) {
+	std::lock_guard< std::mutex > guard(mutex);
+	Entry &entry = entries[name];
+	if (entry.loader) {
+		throw std::runtime_error("Sample '" + name + "' is already in the cache.");
+	}
+	entry.loader = loader;
+}
+
+SampleCache::Entry &SampleCache::use(std::unique_lock< std::mutex > &lock, std::string const &name) {
+	auto f = entries.find(name);
+	if (f == entries.end()) {
+		throw std::runtime_error("Sample named '" + name + "' not found in cache.");
+	}
+	//(std::map entries stay put as others are added, so this reference survives unlocking)
+	Entry &entry = f->second;
+
+	//someone else may be loading this already:
+	loaded.wait(lock, [&entry](){ return !entry.loading; });
+
+	if (!entry.sample) {
+		entry.loading = true;
+		Loader loader = entry.loader;
+		lock.unlock();
+		std::unique_ptr< Sound::Sample > sample;
+		try {
+			sample = std::make_unique< Sound::Sample >(loader());
+		} catch (...) {
+			lock.lock();
+			entry.loading = false;
+			loaded.notify_all();
+			throw;
+		}
+		lock.lock();
+		entry.loading = false;
+		entry.sample = std::move(sample);
+		loaded_bytes += entry.sample->bytes();
+		++loads;
+		loaded.notify_all();
+	}
+
+	entry.last_used = ++use_serial;
+	evict(&entry);
+	return entry;
+}
+
+void SampleCache::evict(Entry const *keep) {
+	while (loaded_bytes > budget_bytes) {
+		//find the least-recently-used loaded sample:
+		// (a linear scan -- caches hold tens to hundreds of samples, and evictions are rare)
+		Entry *oldest = nullptr;
+		for (auto &name_entry : entries) {
+			Entry &entry = name_entry.second;
+			if (!entry.sample || &entry == keep) continue;
+			if (!oldest || entry.last_used < oldest->last_used) oldest = &entry;
+		}
+		if (!oldest) break; //only 'keep' is left; it's allowed to be over budget on its own
+
+		//(sounds still playing this sample hold their own reference to its data)
+		loaded_bytes -= oldest->sample->bytes();
+		oldest->sample.reset();
+		++evictions;
+	}
+}
+
+Sound::Sample SampleCache::get(std::string const &name) {
+	std::unique_lock< std::mutex > lock(mutex);
+	return *use(lock, name).sample;
+}
+
+void SampleCache::prefetch(std::string const &name) {
+	std::unique_lock< std::mutex > lock(mutex);
+	Sound::Sample sample = *use(lock, name).sample;
+	lock.unlock();
+
+	//read through the data, so that samples viewing a mapped file (e.g., from a SoundBank)
+	// get paged in here rather than in the audio callback:
+	float scratch[1024];
+	for (size_t begin = 0; begin < sample.size(); begin += 1024) {
+		sample.decode(begin, std::min< size_t >(1024, sample.size() - begin), scratch);
+	}
+}
+
+bool SampleCache::resident(std::string const &name) const {
+	std::lock_guard< std::mutex > guard(mutex);
+	auto f = entries.find(name);
+	return f != entries.end() && f->second.sample;
+}
+
+void SampleCache::set_budget(size_t budget) {
+	std::lock_guard< std::mutex > guard(mutex);
+	budget_bytes = budget;
+	evict(nullptr);
+}
+
+size_t SampleCache::budget() const {
+	std::lock_guard< std::mutex > guard(mutex);
+	return budget_bytes;
+}
+
+size_t SampleCache::resident_bytes() const {
+	std::lock_guard< std::mutex > guard(mutex);
+	return loaded_bytes;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+ * A SampleCache holds named Sound::Samples that are only loaded when needed,
+ *  and keeps the total size of the loaded ones under a byte budget.
+ * Each entry is registered with a loader function (decode a file, look up a
+ *  SoundBank entry, time-stretch another entry, ...), which is run the first time
+ *  the sample is asked for with get() or prefetch().
+ * When the loaded samples go over budget, the least-recently-used ones are
+ *  dropped from the cache (and will be loaded again if asked for).
+ * Dropping a sample never pulls data out from under a sound that is playing it:
+ *  playing sounds keep their data alive (see Sound::Sample), so evicted data is
+ *  freed once the last sound using it finishes.
+ *
+ * prefetch() also reads through the sample's data, so memory-mapped samples
+ *  (see SoundBank) are paged in ahead of time too.
+ *
+ * get() and prefetch() may be called from any thread; loaders run outside the
+ *  cache's lock, and a sample that is already being loaded is waited for rather
+ *  than loaded twice.
+ */
+
+#include "Sound.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct SampleCache {
+	using Loader = std::function< Sound::Sample() >;
+
+	//'budget' is how many bytes of sample data (see Sound::Sample::bytes) may stay loaded:
+	SampleCache(size_t budget);
+
+	//register a sample (not loaded until it is needed):
+	// note: will throw if 'name' is already registered.
+	void add(std::string const &name, Loader const &loader);
+
+	//get a sample, loading it first (and waiting for that) if needed; marks it as recently used:
+	// note: will throw if 'name' isn't registered, or if the loader throws.
+	Sound::Sample get(std::string const &name);
+
+	//load (and page in) a sample if needed, e.g., on a worker thread ahead of playing it; marks it as recently used:
+	void prefetch(std::string const &name);
+
+	//is the sample currently loaded?
+	bool resident(std::string const &name) const;
+
+	//change the budget (evicts right away if needed):
+	void set_budget(size_t budget);
+
+	size_t budget() const;
+	size_t resident_bytes() const;
+
+	//-- internals ---
+
+	struct Entry {
+		Loader loader;
+		std::unique_ptr< Sound::Sample > sample; //loaded data, if any
+		bool loading = false; //is some thread running 'loader' right now?
+		uint64_t last_used = 0; //value of 'use_serial' at last get/prefetch
+	};
+
+	//find (loading if needed) and mark the entry, with 'lock' held on 'mutex':
+	Entry &use(std::unique_lock< std::mutex > &lock, std::string const &name);
+
+	//drop least-recently-used samples (other than 'keep') until under budget, with 'mutex' held:
+	void evict(Entry const *keep);
+
+	mutable std::mutex mutex;
+	std::condition_variable loaded; //notified whenever a load finishes
+	std::map< std::string, Entry > entries;
+	size_t budget_bytes = 0;
+	size_t loaded_bytes = 0;
+	uint64_t use_serial = 0;
+
+	//counters (for tuning the budget):
+	uint64_t loads = 0;
+	uint64_t evictions = 0;
+};
@@ -1,27 +1,381 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "mix_kernels.hpp"
+#include "mix_workers.hpp"
+#include "hrtf.hpp"
+#include "bus_effects.hpp"
+#include "adpcm.hpp"
+#include "spsc_ring.hpp"
+#include "opus_stream.hpp"
 
 #include <SDL.h>
 
-#include <list>
+#include <atomic>
+#include <chrono>
 #include <cassert>
 #include <exception>
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <unordered_map>
+#include <stdexcept>
 #include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
 
 //local (to this file) data used by the audio system:
 namespace {
 
 	//handy constants:
 	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	//number of samples to mix per call of mix_audio callback is set at runtime (see Sound::Latency),
+	// between these limits; n.b. SDL requires it to be a power of two:
+	constexpr uint32_t const MIN_MIX_SAMPLES = 128;
+	constexpr uint32_t const MAX_MIX_SAMPLES = 1024; //(per-block scratch buffers are sized for this)
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//current block size; only changes while the device is closed:
+	std::atomic< uint32_t > mix_samples{MAX_MIX_SAMPLES};
+
+	//playback rate limits (see PlayingSample::set_rate):
+	constexpr float const MIN_RATE = 1.0f / 8.0f;
+	constexpr float const MAX_RATE = 4.0f;
+
+	//Voices live in a fixed-size pool, allocated by Sound::init, so that starting and finishing
+	// playback never allocates or frees memory (in particular, not in the audio callback).
+	//
+	//Each voice has a 'slot' word that packs a generation count with a state, and handles
+	// (Sound::PlayingSample) remember the generation they were issued for.
+	//The audio thread bumps the generation whenever a voice finishes, which makes old handles stale.
+	//
+	//Slot state transitions:
+	//   Free    --(game: play)-->    Claimed --(audio: Play command)--> Playing
+	//   Playing --(game: steal)-->   Stolen  --(audio: Play command)--> Playing
+	//   Playing --(audio: finished)--> Free
+	enum SlotState : uint32_t {
+		SlotFree = 0,
+		SlotClaimed = 1,
+		SlotPlaying = 2,
+		SlotStolen = 3,
+	};
+	constexpr uint32_t const SLOT_STATE_MASK = 0x3;
+	constexpr uint32_t const SLOT_GENERATION_STEP = 0x4;
+
+	struct Voice {
+		//--- shared between threads ---
+		std::atomic< uint32_t > slot{SlotFree}; //generation (upper bits) | SlotState (lower bits)
+
+		//--- audio thread only ---
+		bool active = false; //currently being mixed?
+		void const *data = nullptr; //sample data being played
+		uint32_t size = 0; //number of values in data
+		uint32_t stride = 1; //distance (in values) between values in data
+		Sound::Sample::Encoding encoding = Sound::Sample::Float; //how data is stored
+		uint32_t stream = OpusStream::None; //stream being played (instead of data), if any
+		uint32_t i = 0; //next data value to read
+		uint32_t frac = 0; //fractional part of the read position (as a fraction of 2^32), when resampling
+		uint64_t start_frame = 0; //audio frame to start on (voice waits silently until then)
+		bool loop = false; //should playback loop after data runs out?
+		bool stopping = false; //is playback fading out?
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+		Sound::Ramp< float > rate = Sound::Ramp< float >(1.0f);
+
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		Sound::Ramp< float > pan = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		//3D playback panning control: ('NaN' if sound played in 2D mode)
+		Sound::Ramp< glm::vec3 > position = Sound::Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
+		Sound::Ramp< float > half_volume_radius = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		float priority = 0.0f; //(see PlayingSample::set_priority)
+		Sound::Bus bus = Sound::MasterBus; //bus the voice plays into
+
+		//--- audio thread, worked out per block by mix_audio ---
+		float gain_l = 0.0f; //gains at the start of the block...
+		float gain_r = 0.0f;
+		float gain_step_l = 0.0f; //...and their change per frame over the block
+		float gain_step_r = 0.0f;
+		float audibility = 0.0f; //largest gain over the block
+		float block_rate = 1.0f; //playback rate for the block
+		uint32_t block_first = 0; //frame of the block the voice starts playing on (see play_at)
+		bool real = false; //is the voice being mixed this block? (otherwise it is virtual: only moved along)
+		bool binaural = false; //is the voice filtered by the HRTF this block? (then gain_l is its unpanned gain)
+		glm::vec3 direction_from = glm::vec3(0.0f); //direction (in listener space) at the start of the block...
+		glm::vec3 direction_to = glm::vec3(0.0f); //...and at the end, for binaural voices
+		bool finished = false; //did the voice run out (or fade out) while being mixed this block?
+
+		//--- game thread only (used to pick a voice to steal) ---
+		uint64_t started = 0; //value of 'voice_serial' when this voice was last started
+		bool looping = false; //was this voice started with loop()?
+		bool stop_requested = false; //has stop() been called on this voice?
+		//keep sample data alive while the audio thread might read it:
+		// 'buffer' is what was last started; 'retired' is what it replaced, which a stolen voice
+		// keeps reading until its Play command is applied (and so is let go at the next claim):
+		std::shared_ptr< void const > buffer;
+		std::shared_ptr< void const > retired;
+	};
+	std::unique_ptr< Voice[] > voices;
+	uint32_t voice_count = 0;
+	std::unique_ptr< uint32_t[] > audible_voices; //(audio thread) scratch space for picking real voices
+	std::unique_ptr< uint32_t[] > bus_voices; //(audio thread) scratch space for grouping real voices by bus
+
+	//optional worker threads that help mix blocks with many voices (see Sound::set_mix_threads),
+	// and a private block buffer for each of them:
+	std::unique_ptr< MixWorkers > mix_workers;
+	std::unique_ptr< float[] > chunk_buffers;
+	//(with the device lock held) have the workers been given the mixer thread's priority? (see mixer_main)
+	bool mix_workers_matched = false;
+	//(handing a chunk to another thread costs about as much as mixing a few voices, so chunks are at least this big)
+	constexpr uint32_t const MIN_VOICES_PER_CHUNK = 16;
+
+	//binaural rendering of 3D voices (see Sound::set_hrtf), and convolution state for each voice:
+	std::shared_ptr< HRTF const > hrtf_set;
+	std::vector< HRTFConvolver > convolvers;
+	static_assert(MIN_MIX_SAMPLES % HRTF::Partition == 0, "blocks should be whole HRTF partitions");
+
+	//Buses (see Sound::add_bus) -- a bus's parent always has a lower index than it does,
+	// so mixing buses down in reverse index order handles children before their parents:
+	constexpr uint32_t const MAX_BUSES = 16;
+	constexpr uint32_t const MAX_BUS_EFFECTS = 8;
+	struct BusState {
+		Sound::Bus parent = Sound::MasterBus;
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f); //(audio thread)
+		//effect chain (only changed with the callback locked out -- see Sound::add_effect):
+		std::array< std::shared_ptr< Effect >, MAX_BUS_EFFECTS > effects;
+		uint32_t effect_count = 0;
+		//(audio thread) has anything been mixed into 'block' yet this block?
+		bool used = false;
+		float block[2 * MAX_MIX_SAMPLES]; //(MasterBus mixes straight into the output instead)
+	};
+	std::array< BusState, MAX_BUSES > buses;
+	uint32_t bus_count = 4; //(only changed with the callback locked out)
+	std::vector< std::string > bus_names = {"master", "music", "sfx", "voice"}; //(game thread)
+
+	//virtual voice settings (see Sound::set_virtual_voices):
+	std::atomic< float > virtual_threshold{1e-4f};
+	std::atomic< uint32_t > real_voice_limit{~0U};
+	uint64_t voice_serial = 0; //(game thread) counts voice starts
+
+	//Changes requested by the game thread are queued as commands and applied by mix_audio
+	// at the start of the next block, so the game thread never waits on the audio device lock:
+	struct Command {
+		enum Type : uint32_t {
+			Play, //start voice 'index' playing 'data'/'size' or 'stream'
+			Stop, //fade out voice over 'ramp'
+			StopAll, //fade out all playing voices over 'ramp'
+			SetVolume, //ramp voice volume to 'value.x'
+			SetPan, //ramp voice pan to 'value.x'
+			SetPosition, //ramp voice position to 'value'
+			SetHalfVolumeRadius, //ramp voice half-volume radius to 'value.x'
+			SetRate, //ramp voice playback rate to 'value.x'
+			SetPriority, //set voice priority to 'value.x'
+			SetGlobalVolume, //ramp Sound::volume to 'value.x'
+			SetBusVolume, //ramp bus 'index' volume to 'value.x'
+			SetListener, //ramp Sound::listener position to 'value' and right to 'right'
+		} type = Play;
+		//voice the command applies to; ignored if the voice's generation has moved on:
+		uint32_t index = 0;
+		uint32_t generation = 0;
+		glm::vec3 value = glm::vec3(0.0f);
+		glm::vec3 right = glm::vec3(0.0f);
+		float ramp = 0.0f;
+		//Play only:
+		void const *data = nullptr;
+		uint32_t size = 0;
+		uint32_t stride = 1;
+		Sound::Sample::Encoding encoding = Sound::Sample::Float;
+		uint32_t stream = OpusStream::None;
+		bool loop = false;
+		uint64_t start_frame = 0;
+		float volume = 1.0f;
+		float pan = 0.0f; //(NaN for 3D)
+		float half_volume_radius = 0.0f; //(NaN for 2D)
+		Sound::Bus bus = Sound::MasterBus;
+	};
+	SPSCRing< Command, 1024 > commands;
+
+	//Voices that finished are reported back to the game thread (see Sound::poll_events) through another ring:
+	struct Finished {
+		uint32_t index = 0;
+		uint32_t generation = 0; //generation of the sound that finished
+	};
+	SPSCRing< Finished, 1024 > finished;
+	std::atomic< bool > finished_overflow{false}; //set when an event didn't fit in 'finished'
+
+	//(game thread) on_finished callbacks, keyed by finished_key(), and callbacks to run at the next poll:
+	std::unordered_map< uint64_t, std::function< void() > > finished_callbacks;
+	std::vector< std::function< void() > > ready_callbacks;
+	uint64_t finished_key(uint32_t index, uint32_t generation) {
+		return (uint64_t(index) << 32) | generation;
+	}
+
+	//The output tap (see Sound::read_tap) -- interleaved stereo, room for a few of the largest blocks:
+	// (written only by mix_audio, read only by read_tap)
+	SPSCRing< float, 16384 > tap;
+	std::atomic< bool > tap_on{false};
+
+	//the audio frame clock -- first frame of the next block mix_audio will produce:
+	std::atomic< uint64_t > next_block_frame{0};
+
+	//Callback timing, for Sound::stats().
+	// Written by the audio callback (lock waits: by Sound::lock on the game thread) and read by stats(),
+	// so everything is a relaxed atomic -- no locks, and nothing that could make the callback wait:
+	struct CallbackStats {
+		std::atomic< uint64_t > callbacks{0};
+		std::atomic< uint64_t > overruns{0};
+		std::atomic< uint64_t > total_ns{0};
+		std::atomic< uint64_t > last_ns{0};
+		std::atomic< uint64_t > max_ns{0};
+		std::atomic< uint64_t > max_late_ns{0};
+		std::atomic< uint32_t > voices{0};
+		std::atomic< uint32_t > max_voices{0};
+		std::atomic< uint32_t > virtual_voices{0};
+		std::atomic< uint64_t > lock_wait_max_ns{0};
+		std::atomic< uint64_t > lock_wait_total_ns{0};
+		std::array< std::atomic< uint64_t >, Sound::Stats::Buckets > histogram;
+		//device callbacks (see device_audio) that probably left the device dry:
+		std::atomic< uint64_t > underruns{0};
+		//longest device callback since the latency controller last looked (see Sound::update_latency):
+		std::atomic< uint64_t > device_max_ns{0};
+		//blocks that didn't fit in the tap:
+		std::atomic< uint64_t > tap_dropped{0};
+	};
+	CallbackStats callback_stats; //(static storage, so the histogram starts zeroed)
+
+	//time one block of 'frames' frames lasts (so, the budget for mixing it):
+	uint64_t block_ns(uint32_t frames) {
+		return uint64_t(frames) * 1000000000ULL / AUDIO_RATE;
+	}
+
+	//helper: raise an atomic maximum (single writer, so no compare-exchange needed):
+	template< typename T >
+	void raise_max(std::atomic< T > &max, T value) {
+		if (value > max.load(std::memory_order_relaxed)) max.store(value, std::memory_order_relaxed);
+	}
+
+	//helper: record one callback's timing (audio callback only):
+	void record_callback(std::chrono::steady_clock::time_point start, uint32_t voices_mixed, uint32_t voices_virtual, uint32_t frames) {
+		static std::chrono::steady_clock::time_point previous_start;
+		static bool have_previous = false;
+
+		uint64_t budget = block_ns(frames);
+		uint64_t ns = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count());
+		if (have_previous) {
+			uint64_t period = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(start - previous_start).count());
+			if (period > budget) raise_max(callback_stats.max_late_ns, period - budget);
+		}
+		previous_start = start;
+		have_previous = true;
+
+		callback_stats.callbacks.fetch_add(1, std::memory_order_relaxed);
+		callback_stats.total_ns.fetch_add(ns, std::memory_order_relaxed);
+		callback_stats.last_ns.store(ns, std::memory_order_relaxed);
+		raise_max(callback_stats.max_ns, ns);
+		callback_stats.voices.store(voices_mixed, std::memory_order_relaxed);
+		raise_max(callback_stats.max_voices, voices_mixed);
+		callback_stats.virtual_voices.store(voices_virtual, std::memory_order_relaxed);
+
+		uint64_t bucket = ns * 10 / budget;
+		if (bucket >= 10) {
+			callback_stats.overruns.fetch_add(1, std::memory_order_relaxed);
+			bucket = 10;
+		}
+		callback_stats.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	//helper: apply a command to the mixer state (audio callback or device lock only):
+	void apply_command(Command &command);
+
+	//helper: apply all queued commands (audio callback or device lock only):
+	void apply_commands() {
+		Command command;
+		while (commands.pop(&command)) {
+			apply_command(command);
+		}
+	}
+
+	//helper: queue a command for the audio callback (game thread only):
+	void push_command(Command const &command) {
+		if (commands.push(command)) return;
+		//The ring is full -- the callback isn't draining it (no device, or a long stall).
+		//Apply the queued commands and this one here, in order, with the callback locked out:
+		Sound::lock();
+		apply_commands();
+		Command copy = command;
+		apply_command(copy);
+		Sound::unlock();
+	}
+
+	//helper: reserve a voice for a new sound (game thread only).
+	// uses a free voice if there is one; otherwise steals (in order of preference)
+	// the oldest voice that is already being stopped, the oldest non-looping voice, or the oldest voice.
+	// returns false if there are no voices at all (Sound::init not called).
+	bool claim_voice(uint32_t *index_, uint32_t *generation_) {
+		if (voice_count == 0) return false;
+
+		for (uint32_t v = 0; v < voice_count; ++v) {
+			uint32_t slot = voices[v].slot.load(std::memory_order_acquire);
+			if ((slot & SLOT_STATE_MASK) != SlotFree) continue;
+			if (voices[v].slot.compare_exchange_strong(slot, (slot & ~SLOT_STATE_MASK) | SlotClaimed, std::memory_order_acq_rel)) {
+				*index_ = v;
+				*generation_ = slot & ~SLOT_STATE_MASK;
+				return true;
+			}
+		}
+
+		//pool is full; pick a victim:
+		for (;;) {
+			uint32_t best = voice_count;
+			auto rank = [](Voice const &voice) {
+				if (voice.stop_requested) return 0;
+				if (!voice.looping) return 1;
+				return 2;
+			};
+			for (uint32_t v = 0; v < voice_count; ++v) {
+				uint32_t state = voices[v].slot.load(std::memory_order_acquire) & SLOT_STATE_MASK;
+				if (state == SlotFree) {
+					//a voice finished while we were looking; take it the normal way:
+					return claim_voice(index_, generation_);
+				}
+				if (state != SlotPlaying) continue; //already claimed/stolen but not yet started
+				if (best == voice_count
+				 || rank(voices[v]) < rank(voices[best])
+				 || (rank(voices[v]) == rank(voices[best]) && voices[v].started < voices[best].started)) {
+					best = v;
+				}
+			}
+			if (best == voice_count) {
+				//every voice has been (re)claimed since the last mixed block; drop this sound:
+				return false;
+			}
+			uint32_t slot = voices[best].slot.load(std::memory_order_acquire);
+			if ((slot & SLOT_STATE_MASK) != SlotPlaying) continue;
+			if (voices[best].slot.compare_exchange_strong(slot, (slot & ~SLOT_STATE_MASK) | SlotStolen, std::memory_order_acq_rel)) {
+				//the audio thread will end the current voice exactly once, bumping the generation:
+				*index_ = best;
+				*generation_ = (slot & ~SLOT_STATE_MASK) + SLOT_GENERATION_STEP;
+				return true;
+			}
+		}
+	}
 
 }
 
@@ -36,9 +390,330 @@ Sound::Listener Sound::listener;
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
 
+//The device callback -- mix_audio, plus resampling if the device didn't open at AUDIO_RATE:
+void device_audio(void *, Uint8 *buffer_, int len);
+void fill_device_buffer(Uint8 *buffer_, int len);
+void resample_to_device(Uint8 *buffer_, int len, uint32_t mix_frames);
+
+//With a mixer thread (see Sound::Latency::mixer_thread), the device callback only copies out what the thread mixed:
+void queued_audio(void *, Uint8 *buffer_, int len);
+
+namespace {
+	//When the device runs at some other rate, mixed blocks are resampled to the device's rate:
+	struct OutputResampler {
+		uint32_t device_rate = AUDIO_RATE;
+		uint64_t step = 1ULL << 32; //mixed frames per device frame (32.32 fixed point)
+		float const *filter = nullptr;
+		//mixed frames not yet consumed, one channel per array (starts with RESAMPLE_TAPS/2-1 frames of silent history):
+		std::array< std::vector< float >, 2 > pending;
+		uint32_t pending_count = 0;
+		uint64_t position = 0; //(32.32) read position of the next device frame in 'pending' (see resample_polyphase)
+	} output;
+
+	//duration of one device callback's buffer (set when the device opens; read by device_audio):
+	std::atomic< uint64_t > device_buffer_ns{0};
+	//(audio thread, or while the device is closed) start of the previous device callback, to spot late ones:
+	std::chrono::steady_clock::time_point device_previous_start;
+	bool device_have_previous = false;
+
+	//(game thread) state for adaptive latency (see Sound::update_latency):
+	struct LatencyControl {
+		bool adaptive = false;
+		//underruns up to the last check (any beyond this are new):
+		uint64_t seen_underruns = 0;
+		//when the block size last changed, and when the device last ran dry (or the size changed):
+		std::chrono::steady_clock::time_point changed;
+		std::chrono::steady_clock::time_point calm_since;
+		//how long to go without underruns before trying a smaller block:
+		// (doubles whenever a smaller block turns out to underrun soon after the change)
+		std::chrono::seconds shrink_after = std::chrono::seconds(10);
+		bool shrunk = false; //was the last change a shrink?
+		bool grow = false; //did the device run dry since the block size last changed? (grows once nothing is playing)
+	} latency_control;
+
+	//underruns this soon after (re)opening the device are put down to the reopen itself:
+	constexpr std::chrono::milliseconds const LATENCY_SETTLE = std::chrono::milliseconds(500);
+	//shrink only if the longest callback would have used less than this fraction of the smaller block:
+	constexpr uint64_t const LATENCY_SHRINK_HEADROOM = 4; //(i.e., under a quarter)
+	constexpr std::chrono::seconds const LATENCY_MAX_SHRINK_AFTER = std::chrono::seconds(320);
+
+	//The mixer thread (see Sound::Latency::mixer_thread) mixes device buffers into 'queue' until 'ahead'
+	// of them are waiting, then sleeps until queued_audio takes one:
+	struct MixerThread {
+		bool wanted = false; //(game thread) use a mixer thread when the device opens?
+		bool running = false; //(game thread; only changes while the device is closed)
+		std::thread thread;
+		//held while mixing -- with a mixer thread, Sound::lock takes this instead of the SDL device lock:
+		std::mutex mix_mutex;
+		//the thread waits on 'wake' while the queue is full (and the game thread waits on it for 'ready'):
+		std::mutex wake_mutex;
+		std::condition_variable wake;
+		bool ready = false; //(wake_mutex) has the thread set itself up and filled the queue?
+		std::atomic< bool > quit{false};
+		uint32_t ahead = 2; //device buffers to keep queued
+		uint32_t buffer_floats = 0; //size of one device buffer (interleaved stereo)
+		SPSCRing< float, 16384 > queue; //(room for 'ahead' of the largest device buffers)
+		//(set by the thread before it is ready):
+		char const *priority = "normal";
+	} mixer;
+	constexpr uint32_t const MAX_MIXER_AHEAD = 4;
+	static_assert(MAX_MIXER_AHEAD * 2 * MAX_MIX_SAMPLES <= 16384, "mixer queue holds 'ahead' of the largest buffers");
+
+	//Memory the mixer touches is locked in RAM (best effort -- see `ulimit -l`), so it can't page-fault:
+	std::atomic< uint64_t > locked_bytes{0}; //(what lock_memory has locked and unlock_memory hasn't unlocked)
+	std::atomic< bool > lock_refused{false}; //(once the system says no, stop asking until something is unlocked)
+
+	uintptr_t page_size() {
+#if defined(__linux__) || defined(__APPLE__)
+		return uintptr_t(sysconf(_SC_PAGESIZE));
+#elif defined(_WIN32)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return uintptr_t(info.dwPageSize);
+#else
+		return 4096;
+#endif
+	}
+
+	//helper: ask the system to keep the pages of [begin, begin + bytes) in RAM (no bookkeeping):
+	bool lock_pages(void const *begin, size_t bytes) {
+#if defined(__linux__) || defined(__APPLE__)
+		//(POSIX allows mlock to insist on whole pages)
+		uintptr_t first = reinterpret_cast< uintptr_t >(begin) & ~(page_size() - 1);
+		uintptr_t end = reinterpret_cast< uintptr_t >(begin) + bytes;
+		return mlock(reinterpret_cast< void const * >(first), end - first) == 0;
+#elif defined(_WIN32)
+		//(limited by the process's minimum working set, so this gives up sooner than on other systems)
+		return VirtualLock(const_cast< void * >(begin), bytes) != 0;
+#else
+		(void)begin;
+		(void)bytes;
+		return false;
+#endif
+	}
+
+	//helper: lock [begin, begin + bytes) in RAM; returns false if the system wouldn't:
+	bool lock_memory(void const *begin, size_t bytes) {
+		if (bytes == 0) return true;
+		if (lock_refused.load(std::memory_order_relaxed)) return false;
+		if (!lock_pages(begin, bytes)) {
+			lock_refused.store(true, std::memory_order_relaxed);
+			return false;
+		}
+		locked_bytes.fetch_add(bytes, std::memory_order_relaxed);
+		return true;
+	}
+
+	//helper: undo lock_memory(begin, bytes):
+	// (only pages wholly inside the range are unlocked -- the ones at either end may hold other locked memory)
+	void unlock_memory(void const *begin, size_t bytes) {
+		if (bytes == 0) return;
+		uintptr_t page = page_size();
+		uintptr_t first = (reinterpret_cast< uintptr_t >(begin) + page - 1) & ~(page - 1);
+		uintptr_t end = (reinterpret_cast< uintptr_t >(begin) + bytes) & ~(page - 1);
+		if (first < end) {
+#if defined(__linux__) || defined(__APPLE__)
+			munlock(reinterpret_cast< void const * >(first), end - first);
+#elif defined(_WIN32)
+			VirtualUnlock(reinterpret_cast< void * >(first), end - first);
+#endif
+		}
+		locked_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+		lock_refused.store(false, std::memory_order_relaxed); //(maybe there's room again)
+	}
+
+	//what the mixer thread locked for itself when it started (unlocked by close_audio_device, after it stops):
+	struct LockedRange {
+		void const *begin = nullptr;
+		size_t bytes = 0;
+	};
+	std::vector< LockedRange > mixer_locked;
+
+	//(game thread) sample data locked for the mixer thread, by first sample, so each buffer is locked once:
+	// (a buffer that has since been freed doesn't count -- its address may now hold some other sample)
+	struct LockedSample {
+		std::weak_ptr< void const > buffer;
+		size_t bytes = 0;
+	};
+	std::unordered_map< void const *, LockedSample > locked_samples;
+
+	//helper: (game thread) unlock and forget sample data that has since been freed:
+	void sweep_locked_samples() {
+		bool unlocked = false;
+		for (auto entry = locked_samples.begin(); entry != locked_samples.end(); ) {
+			if (!entry->second.buffer.expired()) {
+				++entry;
+				continue;
+			}
+			if (entry->second.bytes) {
+				unlock_memory(entry->first, entry->second.bytes);
+				unlocked = true;
+			}
+			entry = locked_samples.erase(entry);
+		}
+		//live data may have been allocated where freed data was, and so just been unlocked too:
+		if (unlocked) {
+			for (auto const &entry : locked_samples) {
+				lock_pages(entry.first, entry.second.bytes);
+			}
+			for (auto const &range : mixer_locked) {
+				lock_pages(range.begin, range.bytes);
+			}
+		}
+	}
+
+	//helper: (mixer thread) run at real-time priority if allowed, otherwise at least above normal threads:
+	char const *raise_mixer_priority() {
+#if defined(__linux__) || defined(__APPLE__)
+		//(below the kernel's threaded interrupt handlers, which run at 50, so the mixer can't starve the sound card)
+		sched_param param;
+		param.sched_priority = std::max(sched_get_priority_min(SCHED_FIFO), std::min(sched_get_priority_max(SCHED_FIFO), 40));
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) return "SCHED_FIFO";
+#if defined(__linux__)
+		//(without CAP_SYS_NICE or an rtprio limit, maybe a better nice value is allowed; on linux these are per thread)
+		if (setpriority(PRIO_PROCESS, 0, -10) == 0) return "nice -10";
+#endif
+#elif defined(_WIN32)
+		if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) return "time-critical";
+#endif
+		return "normal";
+	}
+
+	//helper: (mixer thread) lock memory for as long as the thread runs:
+	void mixer_lock(void const *begin, size_t bytes) {
+		if (bytes && lock_memory(begin, bytes)) {
+			LockedRange range;
+			range.begin = begin;
+			range.bytes = bytes;
+			mixer_locked.emplace_back(range);
+		}
+	}
+
+	//helper: (mixer thread) fault in and lock the top of the stack, so deep calls don't page-fault later:
+	void lock_mixer_stack() {
+		volatile unsigned char stack[64 * 1024];
+		for (size_t i = 0; i < sizeof(stack); i += 1024) {
+			stack[i] = 0;
+		}
+		mixer_lock(const_cast< unsigned char const * >(stack), sizeof(stack));
+	}
+
+	void mixer_main() {
+		mixer.priority = raise_mixer_priority();
+		{
+			std::lock_guard< std::mutex > lock(mixer.mix_mutex);
+			mix_workers_matched = false;
+		}
+
+		//lock what every block touches (sample data is locked as it starts playing -- see start_voice):
+		// (mixer_locked is the game thread's again once the thread is ready)
+		lock_mixer_stack();
+		mixer_lock(voices.get(), sizeof(Voice) * voice_count);
+		mixer_lock(audible_voices.get(), sizeof(uint32_t) * voice_count);
+		mixer_lock(bus_voices.get(), sizeof(uint32_t) * voice_count);
+		mixer_lock(&buses, sizeof(buses));
+		mixer_lock(&commands, sizeof(commands));
+		mixer_lock(&finished, sizeof(finished));
+		mixer_lock(&tap, sizeof(tap));
+		mixer_lock(&mixer.queue, sizeof(mixer.queue));
+		for (auto const &channel : output.pending) {
+			mixer_lock(channel.data(), channel.size() * sizeof(float));
+		}
+
+		static float buffer[2 * MAX_MIX_SAMPLES];
+		assert(mixer.buffer_floats <= 2 * MAX_MIX_SAMPLES);
+		int const len = int(mixer.buffer_floats * sizeof(float));
+
+		while (!mixer.quit.load(std::memory_order_acquire)) {
+			if (mixer.queue.size() + mixer.buffer_floats <= mixer.ahead * mixer.buffer_floats) {
+				auto start = std::chrono::steady_clock::now();
+				{
+					std::lock_guard< std::mutex > lock(mixer.mix_mutex);
+					//the mixer waits on workers (see MixWorkers::run), so they shouldn't be stuck behind other threads it outranks:
+					if (mix_workers && !mix_workers_matched) {
+						mix_workers->match_priority();
+						mix_workers_matched = true;
+					}
+					fill_device_buffer(reinterpret_cast< Uint8 * >(buffer), len);
+				}
+				uint64_t ns = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count());
+				raise_max(callback_stats.device_max_ns, ns);
+				mixer.queue.push_n(buffer, mixer.buffer_floats);
+				continue;
+			}
+
+			std::unique_lock< std::mutex > lock(mixer.wake_mutex);
+			if (!mixer.ready) {
+				mixer.ready = true;
+				mixer.wake.notify_all();
+			}
+			if (mixer.quit.load(std::memory_order_acquire)) break;
+			//(queued_audio doesn't take wake_mutex before poking, so a poke can slip in before the wait;
+			// the timeout makes that cost a fraction of a buffer rather than a whole one)
+			mixer.wake.wait_for(lock, std::chrono::nanoseconds(device_buffer_ns.load(std::memory_order_relaxed) / 4));
+		}
+	}
+}
+
 //------------------------ public-facing --------------------------------
 
-Sound::Sample::Sample(std::string const &filename) {
+//helper: copy values into a new immutable buffer, aligned for the mixing kernels:
+template< typename T >
+static std::shared_ptr< void const > make_buffer(std::vector< T > const &data) {
+	constexpr std::align_val_t Align = std::align_val_t(32);
+	T *storage = static_cast< T * >(::operator new(std::max< size_t >(1, data.size()) * sizeof(T), Align));
+	std::copy(data.begin(), data.end(), storage);
+	return std::shared_ptr< void const >(storage, [](T const *ptr) {
+		::operator delete(const_cast< T * >(ptr), Align);
+	});
+}
+
+//helper: copy float samples into a new buffer in the given encoding:
+static std::shared_ptr< void const > encode_buffer(std::vector< float > const &data, Sound::Sample::Encoding encoding) {
+	if (encoding == Sound::Sample::Int16) {
+		std::vector< int16_t > values;
+		values.reserve(data.size());
+		for (float f : data) {
+			values.emplace_back(int16_t(std::max(-32768.0f, std::min(32767.0f, std::round(f * 32768.0f)))));
+		}
+		return make_buffer(values);
+	} else if (encoding == Sound::Sample::ADPCM) {
+		return make_buffer(adpcm_encode(data.data(), data.size()));
+	} else {
+		assert(encoding == Sound::Sample::Float);
+		return make_buffer(data);
+	}
+}
+
+//helper: decode 'count' samples starting at sample 'begin' of (data, stride, encoding) into 'out':
+// (used for Sample::decode and by the mixer for anything it can't read in place)
+static void decode_samples(void const *data, Sound::Sample::Encoding encoding, uint32_t stride, size_t begin, uint32_t count, float *out) {
+	if (encoding == Sound::Sample::Float) {
+		float const *src = static_cast< float const * >(data) + begin * stride;
+		if (stride == 1) {
+			std::copy(src, src + count, out);
+		} else {
+			for (uint32_t s = 0; s < count; ++s) {
+				out[s] = src[size_t(s) * stride];
+			}
+		}
+	} else if (encoding == Sound::Sample::Int16) {
+		int16_t const *src = static_cast< int16_t const * >(data) + begin * stride;
+		if (stride == 1) {
+			convert_int16_to_float(src, count, out);
+		} else {
+			for (uint32_t s = 0; s < count; ++s) {
+				out[s] = float(src[size_t(s) * stride]) * (1.0f / 32768.0f);
+			}
+		}
+	} else {
+		assert(encoding == Sound::Sample::ADPCM && stride == 1);
+		adpcm_decode(static_cast< uint8_t const * >(data), begin, count, out);
+	}
+}
+
+Sound::Sample::Sample(std::string const &filename, Encoding encoding_) {
+	std::vector< float > data;
 	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
 		load_wav(filename, &data);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
@@ -46,19 +721,77 @@ Sound::Sample::Sample(std::string const &filename) {
 	} else {
 		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
 	}
+	buffer = encode_buffer(data, encoding_);
+	length = data.size();
+	encoding = encoding_;
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+Sound::Sample::Sample(std::vector< float > const &data, Encoding encoding_) : buffer(encode_buffer(data, encoding_)), length(data.size()), encoding(encoding_) {
 }
 
+Sound::Sample::Sample(std::shared_ptr< void const > const &owner, float const *begin, size_t length_, uint32_t stride_)
+	: Sample(owner, Float, begin, length_, stride_) {
+}
 
+Sound::Sample::Sample(std::shared_ptr< void const > const &owner, int16_t const *begin, size_t length_, uint32_t stride_)
+	: Sample(owner, Int16, begin, length_, stride_) {
+}
 
-void Sound::init() {
-	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
-		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
-		std::cerr << "  (Will continue without audio.)\n" << std::endl;
-		return;
+Sound::Sample::Sample(std::shared_ptr< void const > const &owner, Encoding encoding_, void const *begin, size_t length_, uint32_t stride_)
+	: buffer(owner, begin), length(length_), stride(stride_), encoding(encoding_) {
+	assert(stride >= 1);
+	assert(encoding != ADPCM || stride == 1); //ADPCM data is only read in blocks
+}
+
+Sound::Sample Sound::Sample::slice(size_t begin, size_t end) const {
+	if (!(begin <= end && end <= length)) {
+		throw std::out_of_range("Sample slice [" + std::to_string(begin) + "," + std::to_string(end) + ") is outside of sample of length " + std::to_string(length) + ".");
+	}
+	char const *data = static_cast< char const * >(buffer.get());
+	if (encoding == ADPCM) {
+		if (begin % ADPCM_BLOCK_SAMPLES != 0) {
+			throw std::invalid_argument("ADPCM sample slice must begin on a multiple of " + std::to_string(ADPCM_BLOCK_SAMPLES) + " samples (not " + std::to_string(begin) + ").");
+		}
+		data += begin / ADPCM_BLOCK_SAMPLES * ADPCM_BLOCK_BYTES;
+	} else {
+		data += begin * stride * (encoding == Int16 ? sizeof(int16_t) : sizeof(float));
+	}
+	return Sample(buffer, encoding, data, end - begin, stride);
+}
+
+void Sound::Sample::decode(size_t begin, size_t count, float *out) const {
+	if (!(begin <= length && count <= length - begin)) {
+		throw std::out_of_range("Sample decode [" + std::to_string(begin) + "," + std::to_string(begin + count) + ") is outside of sample of length " + std::to_string(length) + ".");
 	}
+	//(in pieces, since the kernels count in 32 bits)
+	constexpr size_t const Piece = size_t(1) << 20;
+	for (size_t done = 0; done < count; done += Piece) {
+		decode_samples(buffer.get(), encoding, stride, begin + done, uint32_t(std::min(Piece, count - done)), out + done);
+	}
+}
+
+size_t Sound::Sample::bytes() const {
+	if (encoding == ADPCM) return adpcm_bytes(length);
+	return length * (encoding == Int16 ? sizeof(int16_t) : sizeof(float));
+}
+
+Sound::StreamingSample::StreamingSample(std::string const &filename) {
+	if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus")) {
+		throw std::runtime_error("StreamingSample '" + filename + "' doesn't end in \".opus\" -- only opus files can be streamed.");
+	}
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open StreamingSample '" + filename + "'.");
+	}
+	bytes = std::make_shared< std::vector< unsigned char > const >(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+}
+
+
+
+//helper: open the audio device with blocks of 'frames' frames and start playback:
+// returns false (after explaining why) if the device didn't open.
+static bool open_audio_device(uint32_t frames) {
+	assert(device == 0);
 
 	//Based on the example on https://wiki.libsdl.org/SDL_OpenAudioDevice
 	SDL_AudioSpec want, have;
@@ -66,143 +799,743 @@ void Sound::init() {
 	want.freq = AUDIO_RATE;
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
-	want.samples = MIX_SAMPLES;
-	want.callback = mix_audio;
+	want.samples = Uint16(frames);
+	want.callback = (mixer.wanted ? queued_audio : device_audio);
 
-	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+	//the device may run at its native rate (we resample to it ourselves); SDL converts anything else:
+	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
 	if (device == 0) {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
+		return false;
+	}
+
+	mix_samples.store(frames, std::memory_order_relaxed);
+	device_buffer_ns.store(uint64_t(have.samples) * 1000000000ULL / uint64_t(have.freq), std::memory_order_relaxed);
+
+	output.device_rate = uint32_t(have.freq);
+	output.step = (uint64_t(AUDIO_RATE) << 32) / output.device_rate;
+	output.filter = resample_filter(double(AUDIO_RATE) / double(output.device_rate));
+	for (auto &channel : output.pending) {
+		channel.assign(2 * MAX_MIX_SAMPLES + RESAMPLE_TAPS, 0.0f);
+	}
+	output.pending_count = RESAMPLE_TAPS / 2 - 1;
+	output.position = 0;
+
+	auto now = std::chrono::steady_clock::now();
+	latency_control.changed = now;
+	latency_control.calm_since = now;
+	device_have_previous = false;
+
+	if (mixer.wanted) {
+		//start the mixer thread, and let it fill the queue before the device starts taking from it:
+		// (nothing else is running on either end of the queue, so it can be emptied from here)
+		mixer.queue.pop_n(nullptr, mixer.queue.size());
+		mixer.buffer_floats = uint32_t(have.samples) * 2;
+		mixer.quit.store(false, std::memory_order_relaxed);
+		mixer.ready = false;
+		mixer.running = true;
+		mixer.thread = std::thread(mixer_main);
+		std::unique_lock< std::mutex > lock(mixer.wake_mutex);
+		mixer.wake.wait(lock, [](){ return mixer.ready; });
+	}
+
+	//start audio playback:
+	SDL_PauseAudioDevice(device, 0);
+	return true;
+}
+
+//helper: stop playback and close the audio device (if open):
+static void close_audio_device() {
+	if (device == 0) return;
+	SDL_PauseAudioDevice(device, 1);
+	SDL_CloseAudioDevice(device); //(waits for any callback in progress)
+	device = 0;
+
+	if (mixer.running) {
+		{
+			std::lock_guard< std::mutex > lock(mixer.wake_mutex);
+			mixer.quit.store(true, std::memory_order_release);
+			mixer.wake.notify_all();
+		}
+		mixer.thread.join();
+		mixer.running = false;
+
+		for (auto const &range : mixer_locked) {
+			unlock_memory(range.begin, range.bytes);
+		}
+		mixer_locked.clear();
+	}
+}
+
+void Sound::init(uint32_t max_voices, bool open_device, Latency latency) {
+	if (!(latency.frames >= MIN_MIX_SAMPLES && latency.frames <= MAX_MIX_SAMPLES && (latency.frames & (latency.frames - 1)) == 0)) {
+		throw std::invalid_argument("Audio latency of " + std::to_string(latency.frames) + " frames isn't one of 128, 256, 512, or 1024.");
+	}
+	if (latency.mixer_thread && !(latency.ahead >= 1 && latency.ahead <= MAX_MIXER_AHEAD)) {
+		throw std::invalid_argument("Mixer thread can't stay " + std::to_string(latency.ahead) + " buffers ahead; try 1 to " + std::to_string(MAX_MIXER_AHEAD) + ".");
+	}
+	mixer.wanted = latency.mixer_thread;
+	mixer.ahead = latency.ahead;
+	mix_samples.store(latency.frames, std::memory_order_relaxed);
+	latency_control = LatencyControl();
+	latency_control.adaptive = latency.adaptive;
+
+	//allocate the voice pool up front (even if there's no audio device, so handles still work):
+	assert(max_voices > 0);
+	voices.reset(new Voice[max_voices]);
+	audible_voices.reset(new uint32_t[max_voices]);
+	bus_voices.reset(new uint32_t[max_voices]);
+	voice_count = max_voices;
+	if (hrtf_set) convolvers.assign(max_voices, HRTFConvolver(*hrtf_set));
+
+	//start decoding thread for streaming samples:
+	OpusStream::start();
+
+	if (!open_device) return;
+
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
-	} else {
-		//start audio playback:
-		SDL_PauseAudioDevice(device, 0);
-		std::cout << "Audio output initialized." << std::endl;
+		return;
+	}
+
+	//build the resampling filters now rather than in the audio callback:
+	resample_filter(1.0);
+
+	if (!open_audio_device(latency.frames)) {
+		std::cerr << "  (Will continue without audio.)\n" << std::endl;
+		return;
+	}
+
+	std::cout << "Audio output initialized at " << output.device_rate << " Hz";
+	if (output.device_rate != AUDIO_RATE) std::cout << " (resampled from " << AUDIO_RATE << " Hz)";
+	std::cout << " with " << latency.frames << "-frame blocks";
+	if (latency.adaptive) std::cout << " (adaptive)";
+	std::cout << " (using " << mix_kernel_name() << " mixing kernel)." << std::endl;
+	if (mixer.running) {
+		std::cout << "Mixing on a dedicated thread at " << mixer.priority << " priority, " << mixer.ahead << " buffers ahead";
+		if (lock_refused.load(std::memory_order_relaxed)) std::cout << " (couldn't lock all of its memory in RAM; see 'ulimit -l')";
+		std::cout << "." << std::endl;
+	}
+}
+
+void Sound::set_mix_threads(uint32_t threads) {
+	threads = std::max(1U, threads);
+	if (threads == (mix_workers ? mix_workers->size() + 1 : 1U)) return;
+
+	//start the new workers outside the lock:
+	std::unique_ptr< MixWorkers > workers;
+	std::unique_ptr< float[] > buffers;
+	if (threads > 1) {
+		workers.reset(new MixWorkers(threads - 1));
+		buffers.reset(new float[size_t(threads - 1) * 2 * MAX_MIX_SAMPLES]);
+	}
+
+	Sound::lock();
+	std::swap(mix_workers, workers);
+	std::swap(chunk_buffers, buffers);
+	mix_workers_matched = false;
+	Sound::unlock();
+	//(old workers, if any, stop here -- after the callback has let go of them)
+}
+
+void Sound::set_hrtf(std::shared_ptr< HRTF const > const &hrtf) {
+	//build the new convolvers outside the lock:
+	std::vector< HRTFConvolver > fresh;
+	if (hrtf) fresh.assign(voice_count, HRTFConvolver(*hrtf));
+	std::shared_ptr< HRTF const > set = hrtf;
+
+	Sound::lock();
+	std::swap(hrtf_set, set);
+	std::swap(convolvers, fresh);
+	Sound::unlock();
+	//(old set and convolvers, if any, are freed here)
+}
+
+void Sound::set_tap(bool enabled) {
+	if (enabled && !tap_on.load(std::memory_order_relaxed)) {
+		tap.pop_n(nullptr, tap.size()); //(stale blocks from the last time it was on)
+	}
+	tap_on.store(enabled, std::memory_order_relaxed);
+}
+
+bool Sound::tap_enabled() {
+	return tap_on.load(std::memory_order_relaxed);
+}
+
+uint32_t Sound::read_tap(std::vector< float > *frames) {
+	assert(frames);
+	uint32_t available = tap.size() & ~1u; //(whole frames only -- blocks always arrive whole anyway)
+	size_t at = frames->size();
+	frames->resize(at + available);
+	uint32_t got = tap.pop_n(frames->data() + at, available);
+	frames->resize(at + got);
+	return got / 2;
+}
+
+Sound::Bus Sound::add_bus(std::string const &name, Bus parent) {
+	if (std::find(bus_names.begin(), bus_names.end(), name) != bus_names.end()) {
+		throw std::runtime_error("There is already a bus named '" + name + "'.");
+	}
+	if (parent >= bus_count) {
+		throw std::runtime_error("Parent bus " + std::to_string(parent) + " (of '" + name + "') doesn't exist.");
+	}
+	if (bus_count == MAX_BUSES) {
+		throw std::runtime_error("Can't add bus '" + name + "'; there are already " + std::to_string(MAX_BUSES) + " buses.");
+	}
+	bus_names.emplace_back(name);
+
+	Sound::lock();
+	Bus bus = bus_count;
+	buses[bus].parent = parent;
+	buses[bus].volume = Ramp< float >(1.0f);
+	bus_count += 1;
+	Sound::unlock();
+	return bus;
+}
+
+Sound::Bus Sound::find_bus(std::string const &name) {
+	auto f = std::find(bus_names.begin(), bus_names.end(), name);
+	if (f == bus_names.end()) {
+		throw std::runtime_error("There is no bus named '" + name + "'.");
+	}
+	return Bus(f - bus_names.begin());
+}
+
+void Sound::add_effect(Bus bus, std::shared_ptr< Effect > const &effect) {
+	assert(effect);
+	if (bus >= bus_count) {
+		throw std::runtime_error("Bus " + std::to_string(bus) + " doesn't exist.");
+	}
+	if (buses[bus].effect_count == MAX_BUS_EFFECTS) {
+		throw std::runtime_error("Bus '" + bus_names[bus] + "' already has " + std::to_string(MAX_BUS_EFFECTS) + " effects.");
 	}
+	Sound::lock();
+	buses[bus].effects[buses[bus].effect_count++] = effect;
+	Sound::unlock();
+}
+
+void Sound::clear_effects(Bus bus) {
+	if (bus >= bus_count) {
+		throw std::runtime_error("Bus " + std::to_string(bus) + " doesn't exist.");
+	}
+	std::array< std::shared_ptr< Effect >, MAX_BUS_EFFECTS > removed;
+	Sound::lock();
+	std::swap(removed, buses[bus].effects);
+	buses[bus].effect_count = 0;
+	Sound::unlock();
+	//(effects no one else holds are freed here)
+}
+
+void Sound::set_virtual_voices(float threshold, uint32_t max_real) {
+	virtual_threshold.store(std::max(0.0f, threshold), std::memory_order_relaxed);
+	real_voice_limit.store(max_real, std::memory_order_relaxed);
+}
+
+uint32_t Sound::latency_frames() {
+	return mix_samples.load(std::memory_order_relaxed);
+}
+
+void Sound::update_latency() {
+	if (!latency_control.adaptive || device == 0) return;
+
+	auto now = std::chrono::steady_clock::now();
+	uint32_t frames = mix_samples.load(std::memory_order_relaxed);
+
+	uint64_t underruns = callback_stats.underruns.load(std::memory_order_relaxed);
+	bool ran_dry = (underruns != latency_control.seen_underruns);
+	latency_control.seen_underruns = underruns;
+	if (now - latency_control.changed < LATENCY_SETTLE) return; //(reopening can make a callback late)
+
+	if (ran_dry) {
+		latency_control.calm_since = now;
+		callback_stats.device_max_ns.store(0, std::memory_order_relaxed);
+		if (frames < MAX_MIX_SAMPLES && !latency_control.grow) {
+			latency_control.grow = true;
+			//a block that was just made smaller didn't work out -- wait longer before trying again:
+			if (latency_control.shrunk && now - latency_control.changed < latency_control.shrink_after) {
+				latency_control.shrink_after = std::min(latency_control.shrink_after * 2, LATENCY_MAX_SHRINK_AFTER);
+			}
+		}
+	}
+
+	uint32_t next = frames;
+	if (latency_control.grow) {
+		next = frames * 2;
+	} else if (frames > MIN_MIX_SAMPLES && now - latency_control.calm_since >= latency_control.shrink_after) {
+		//plenty of headroom for a smaller block?
+		uint64_t longest = callback_stats.device_max_ns.load(std::memory_order_relaxed);
+		if (longest * LATENCY_SHRINK_HEADROOM >= block_ns(frames / 2)) {
+			latency_control.calm_since = now;
+			callback_stats.device_max_ns.store(0, std::memory_order_relaxed);
+			return;
+		}
+		next = frames / 2;
+	}
+	if (next == frames) return;
+
+	//reopening the device drops whatever it has buffered -- a gap of its own -- so only change sizes while nothing is playing:
+	// (a grow waits for that too, rather than follow the underrun with a second gap)
+	for (uint32_t v = 0; v < voice_count; ++v) {
+		if ((voices[v].slot.load(std::memory_order_relaxed) & SLOT_STATE_MASK) != SlotFree) return;
+	}
+	latency_control.grow = false;
+
+	close_audio_device();
+	if (!open_audio_device(next)) {
+		//(fall back to the old size, which worked before)
+		if (!open_audio_device(frames)) {
+			std::cerr << "  (Will continue without audio.)\n" << std::endl;
+			return;
+		}
+		next = frames;
+	}
+	latency_control.shrunk = (next < frames);
+	callback_stats.device_max_ns.store(0, std::memory_order_relaxed);
+	std::cout << "Audio blocks are now " << next << " frames (" << (next < frames ? "plenty of headroom" : "device ran dry") << ")." << std::endl;
 }
 
 
 void Sound::shutdown() {
-	if (device != 0) {
-		//stop audio playback:
-		SDL_PauseAudioDevice(device, 1);
-		SDL_CloseAudioDevice(device);
-		device = 0;
+	close_audio_device();
+
+	OpusStream::stop();
+
+	mix_workers.reset();
+	chunk_buffers.reset();
+
+	//(with the callback gone, nothing else touches the voice pool)
+	voices.reset();
+	audible_voices.reset();
+	bus_voices.reset();
+	convolvers.clear();
+	voice_count = 0;
+
+	//sounds that never finished won't be reporting back:
+	finished.pop_n(nullptr, finished.size());
+	finished_overflow.store(false, std::memory_order_relaxed);
+	finished_callbacks.clear();
+	ready_callbacks.clear();
+	for (auto const &entry : locked_samples) {
+		unlock_memory(entry.first, entry.second.bytes);
 	}
+	locked_samples.clear();
 }
 
 
+void Sound::render_offline(uint32_t frames, float *out) {
+	assert(out || frames == 0);
+
+	//mix_audio always produces whole blocks, so keep any leftover frames for next time:
+	static float leftover[2 * MAX_MIX_SAMPLES];
+	static uint32_t leftover_end = 0; //frames in 'leftover'
+	static uint32_t leftover_begin = 0; //(frames before this have been handed out)
+
+	Sound::lock();
+	while (frames > 0) {
+		if (leftover_begin == leftover_end) {
+			leftover_end = mix_samples.load(std::memory_order_relaxed);
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(leftover), int(leftover_end * 2 * sizeof(float)));
+			leftover_begin = 0;
+		}
+		uint32_t count = std::min(frames, leftover_end - leftover_begin);
+		std::copy(leftover + 2 * leftover_begin, leftover + 2 * (leftover_begin + count), out);
+		leftover_begin += count;
+		out += 2 * count;
+		frames -= count;
+	}
+	Sound::unlock();
+}
+
+Sound::Stats Sound::stats() {
+	Stats ret;
+	ret.callbacks = callback_stats.callbacks.load(std::memory_order_relaxed);
+	ret.overruns = callback_stats.overruns.load(std::memory_order_relaxed);
+	ret.underruns = callback_stats.underruns.load(std::memory_order_relaxed);
+	ret.block_frames = mix_samples.load(std::memory_order_relaxed);
+	ret.budget_ms = block_ns(ret.block_frames) * 1e-6f;
+	ret.last_ms = callback_stats.last_ns.load(std::memory_order_relaxed) * 1e-6f;
+	if (ret.callbacks) ret.mean_ms = float(callback_stats.total_ns.load(std::memory_order_relaxed) / ret.callbacks) * 1e-6f;
+	ret.max_ms = callback_stats.max_ns.load(std::memory_order_relaxed) * 1e-6f;
+	ret.min_headroom_ms = ret.budget_ms - ret.max_ms;
+	ret.max_late_ms = callback_stats.max_late_ns.load(std::memory_order_relaxed) * 1e-6f;
+	ret.voices = callback_stats.voices.load(std::memory_order_relaxed);
+	ret.max_voices = callback_stats.max_voices.load(std::memory_order_relaxed);
+	ret.virtual_voices = callback_stats.virtual_voices.load(std::memory_order_relaxed);
+	ret.lock_wait_max_ms = callback_stats.lock_wait_max_ns.load(std::memory_order_relaxed) * 1e-6f;
+	ret.lock_wait_total_ms = callback_stats.lock_wait_total_ns.load(std::memory_order_relaxed) * 1e-6f;
+	ret.tap_dropped = callback_stats.tap_dropped.load(std::memory_order_relaxed);
+	if (mixer.running) {
+		ret.mixer_priority = mixer.priority;
+		ret.queued_frames = mixer.queue.size() / 2;
+	}
+	ret.locked_bytes = locked_bytes.load(std::memory_order_relaxed);
+	for (uint32_t b = 0; b < Stats::Buckets; ++b) {
+		ret.histogram[b] = callback_stats.histogram[b].load(std::memory_order_relaxed);
+	}
+	return ret;
+}
+
+void Sound::reset_stats() {
+	//(a callback running meanwhile may land in either the old or the new totals; that's fine)
+	callback_stats.callbacks.store(0, std::memory_order_relaxed);
+	callback_stats.overruns.store(0, std::memory_order_relaxed);
+	callback_stats.underruns.store(0, std::memory_order_relaxed);
+	latency_control.seen_underruns = 0;
+	callback_stats.total_ns.store(0, std::memory_order_relaxed);
+	callback_stats.last_ns.store(0, std::memory_order_relaxed);
+	callback_stats.max_ns.store(0, std::memory_order_relaxed);
+	callback_stats.max_late_ns.store(0, std::memory_order_relaxed);
+	callback_stats.voices.store(0, std::memory_order_relaxed);
+	callback_stats.max_voices.store(0, std::memory_order_relaxed);
+	callback_stats.virtual_voices.store(0, std::memory_order_relaxed);
+	callback_stats.lock_wait_max_ns.store(0, std::memory_order_relaxed);
+	callback_stats.lock_wait_total_ns.store(0, std::memory_order_relaxed);
+	callback_stats.tap_dropped.store(0, std::memory_order_relaxed);
+	for (auto &bucket : callback_stats.histogram) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+
 void Sound::lock() {
-	if (device) SDL_LockAudioDevice(device);
+	if (!device) return;
+	auto before = std::chrono::steady_clock::now();
+	if (mixer.running) mixer.mix_mutex.lock();
+	else SDL_LockAudioDevice(device);
+	uint64_t waited = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - before).count());
+	callback_stats.lock_wait_total_ns.fetch_add(waited, std::memory_order_relaxed);
+	raise_max(callback_stats.lock_wait_max_ns, waited);
 }
 
 void Sound::unlock() {
-	if (device) SDL_UnlockAudioDevice(device);
+	if (!device) return;
+	if (mixer.running) mixer.mix_mutex.unlock();
+	else SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+namespace {
+
+//helper: what a voice will play -- either in-memory sample data, or a stream being decoded ahead:
+struct Source {
+	std::shared_ptr< void const > buffer;
+	uint32_t size = 0;
+	uint32_t stride = 1;
+	Sound::Sample::Encoding encoding = Sound::Sample::Float;
+	uint32_t stream = OpusStream::None;
+	size_t bytes = 0; //memory spanned by the sample data, starting at 'buffer'
+};
+
+Source source_for(Sound::Sample const &sample, bool) {
+	Source source;
+	source.buffer = sample.buffer;
+	source.size = uint32_t(sample.length);
+	source.stride = sample.stride;
+	source.encoding = sample.encoding;
+	if (sample.stride == 1 || sample.length == 0) {
+		source.bytes = sample.bytes();
+	} else {
+		source.bytes = ((sample.length - 1) * sample.stride + 1) * (sample.encoding == Sound::Sample::Int16 ? sizeof(int16_t) : sizeof(float));
+	}
+	return source;
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Source source_for(Sound::StreamingSample const &sample, bool loop) {
+	Source source;
+	source.stream = OpusStream::open(sample.bytes, loop);
+	if (source.stream == OpusStream::None) {
+		std::cerr << "WARNING: all " << OpusStream::MaxStreams << " streams are in use; dropping sound." << std::endl;
+	}
+	return source;
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
+//helper: claim a voice and queue a Play command for it:
+Sound::PlayingSample start_voice(Source const &source, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool loop, Sound::Bus bus, uint64_t start_frame = 0) {
+	if (bus >= bus_count) {
+		if (source.stream != OpusStream::None) OpusStream::release(source.stream);
+		throw std::runtime_error("Can't play into bus " + std::to_string(bus) + "; it doesn't exist.");
+	}
+	Sound::PlayingSample playing_sample;
+	if (source.size == 0 && source.stream == OpusStream::None) return playing_sample; //nothing to play
+
+	//the mixer thread shouldn't page-fault reading sample data, so lock it in RAM the first time it plays:
+	if (mixer.running && source.buffer) {
+		auto found = locked_samples.find(source.buffer.get());
+		if (found != locked_samples.end() && found->second.buffer.expired()) {
+			sweep_locked_samples(); //(this address held data that has been freed since)
+		}
+		LockedSample &locked = locked_samples[source.buffer.get()];
+		if (locked.bytes < source.bytes) {
+			if (lock_memory(source.buffer.get(), source.bytes)) {
+				locked_bytes.fetch_sub(locked.bytes, std::memory_order_relaxed); //(was a shorter view of the same data)
+				locked.buffer = source.buffer;
+				locked.bytes = source.bytes;
+			} else {
+				static bool warned = false;
+				if (!warned) std::cerr << "NOTE: couldn't lock sample data in RAM (see 'ulimit -l'); the mixer thread may page-fault." << std::endl;
+				warned = true;
+			}
+		}
+	}
+	if (!claim_voice(&playing_sample.index, &playing_sample.generation)) {
+		std::cerr << "WARNING: no voices available; dropping sound." << std::endl;
+		//the stream (if any) never made it to the audio thread, so give it back here:
+		if (source.stream != OpusStream::None) OpusStream::release(source.stream);
+		return playing_sample;
+	}
+
+	Voice &voice = voices[playing_sample.index];
+	voice.started = ++voice_serial;
+	voice.looping = loop;
+	voice.stop_requested = false;
+	//(whatever 'retired' held was replaced by an earlier Play, which has been applied by now)
+	voice.retired = std::move(voice.buffer);
+	voice.buffer = source.buffer;
+
+	Command command;
+	command.type = Command::Play;
+	command.index = playing_sample.index;
+	command.generation = playing_sample.generation;
+	command.data = source.buffer.get();
+	command.size = source.size;
+	command.stride = source.stride;
+	command.encoding = source.encoding;
+	command.stream = source.stream;
+	command.loop = loop;
+	command.start_frame = start_frame;
+	command.value = position;
+	command.volume = volume;
+	command.pan = pan;
+	command.half_volume_radius = half_volume_radius;
+	command.bus = bus;
+	push_command(command);
+
 	return playing_sample;
 }
 
+} //namespace
+
+Sound::PlayingSample Sound::play(Sample const &sample, float play_volume, float pan, Bus bus) {
+	return start_voice(source_for(sample, false), play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false, bus);
+}
+
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, Bus bus) {
+	return start_voice(source_for(sample, false), play_volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false, bus);
+}
 
+Sound::PlayingSample Sound::loop(Sample const &sample, float play_volume, float pan, Bus bus) {
+	return start_voice(source_for(sample, true), play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), true, bus);
+}
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, Bus bus) {
+	return start_voice(source_for(sample, true), play_volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, true, bus);
 }
 
+uint64_t Sound::frame_clock() {
+	return next_block_frame.load(std::memory_order_acquire);
+}
 
-void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
+Sound::PlayingSample Sound::play_at(Sample const &sample, uint64_t start_frame, float play_volume, float pan, Bus bus) {
+	return start_voice(source_for(sample, false), play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false, bus, start_frame);
+}
+
+std::vector< Sound::PlayingSample > Sound::schedule_sequence(std::vector< SequenceItem > const &items, uint64_t start_frame) {
+	std::vector< PlayingSample > playing;
+	playing.reserve(items.size());
+	uint64_t frame = start_frame;
+	for (auto const &item : items) {
+		assert(item.sample);
+		frame += uint64_t(std::round(std::max(0.0f, item.gap) * AUDIO_RATE));
+		playing.emplace_back(play_at(*item.sample, frame, item.volume, item.pan, item.bus));
+		frame += item.sample->size();
 	}
-	unlock();
+	return playing;
+}
+
+Sound::PlayingSample Sound::play(StreamingSample const &sample, float play_volume, float pan, Bus bus) {
+	return start_voice(source_for(sample, false), play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false, bus);
+}
+
+Sound::PlayingSample Sound::play_3D(StreamingSample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, Bus bus) {
+	return start_voice(source_for(sample, false), play_volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false, bus);
+}
+
+Sound::PlayingSample Sound::loop(StreamingSample const &sample, float play_volume, float pan, Bus bus) {
+	return start_voice(source_for(sample, true), play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), true, bus);
+}
+
+Sound::PlayingSample Sound::loop_3D(StreamingSample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, Bus bus) {
+	return start_voice(source_for(sample, true), play_volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, true, bus);
+}
+
+void Sound::stop_all_samples() {
+	Command command;
+	command.type = Command::StopAll;
+	command.ramp = 1.0f / 60.0f;
+	push_command(command);
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.value.x = new_volume;
+	command.ramp = ramp;
+	push_command(command);
+}
+
+void Sound::set_bus_volume(Bus bus, float new_volume, float ramp) {
+	if (bus >= bus_count) {
+		throw std::runtime_error("Bus " + std::to_string(bus) + " doesn't exist.");
+	}
+	Command command;
+	command.type = Command::SetBusVolume;
+	command.index = bus;
+	command.value.x = new_volume;
+	command.ramp = ramp;
+	push_command(command);
 }
 
 //------------------
 
+//helper: start building a command that targets the voice a handle refers to:
+static Command voice_command(Command::Type type, Sound::PlayingSample const &playing_sample) {
+	Command command;
+	command.type = type;
+	command.index = playing_sample.index;
+	command.generation = playing_sample.generation;
+	return command;
+}
+
 void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
-	}
-	Sound::unlock();
+	if (!*this) return;
+	Command command = voice_command(Command::SetVolume, *this);
+	command.value.x = new_volume;
+	command.ramp = ramp;
+	push_command(command);
 }
 
 void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+	if (!*this) return;
+	Command command = voice_command(Command::SetPan, *this);
+	command.value.x = new_pan;
+	command.ramp = ramp;
+	push_command(command);
 }
 
 void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+	if (!*this) return;
+	Command command = voice_command(Command::SetPosition, *this);
+	command.value = new_position;
+	command.ramp = ramp;
+	push_command(command);
 }
 
 void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+	if (!*this) return;
+	Command command = voice_command(Command::SetHalfVolumeRadius, *this);
+	command.value.x = new_radius;
+	command.ramp = ramp;
+	push_command(command);
+}
+
+void Sound::PlayingSample::set_rate(float new_rate, float ramp) {
+	if (!*this) return;
+	Command command = voice_command(Command::SetRate, *this);
+	command.value.x = std::max(MIN_RATE, std::min(MAX_RATE, new_rate));
+	command.ramp = ramp;
+	push_command(command);
+}
+
+void Sound::PlayingSample::set_priority(float new_priority) {
+	if (!*this) return;
+	Command command = voice_command(Command::SetPriority, *this);
+	command.value.x = new_priority;
+	push_command(command);
 }
 
 void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
+	if (!*this) return;
+	if (!stopped()) {
+		//remember (for voice stealing) that this voice is on its way out:
+		voices[index].stop_requested = true;
+	}
+	Command command = voice_command(Command::Stop, *this);
+	command.ramp = ramp;
+	push_command(command);
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (!*this || index >= voice_count) return true;
+	uint32_t slot = voices[index].slot.load(std::memory_order_acquire);
+	return (slot & ~SLOT_STATE_MASK) != generation;
+}
+
+void Sound::PlayingSample::on_finished(std::function< void() > const &callback) {
+	if (stopped()) {
+		//(its event may already have been polled, so don't wait for one)
+		ready_callbacks.emplace_back(callback);
 	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
+		//(the generation is bumped before the event is queued, so the event can't have been polled yet)
+		finished_callbacks[finished_key(index, generation)] = callback;
+	}
+}
+
+void Sound::poll_events(std::vector< PlayingSample > *finished_) {
+	//(a convenient place to let go of locked sample data that has been freed)
+	if (!locked_samples.empty()) sweep_locked_samples();
+
+	//collect callbacks first and run them after, so they can start (and register callbacks on) new sounds:
+	std::vector< std::function< void() > > to_call;
+	to_call.swap(ready_callbacks);
+
+	Finished event;
+	while (finished.pop(&event)) {
+		if (finished_) {
+			PlayingSample sample;
+			sample.index = event.index;
+			sample.generation = event.generation;
+			finished_->emplace_back(sample);
+		}
+		auto f = finished_callbacks.find(finished_key(event.index, event.generation));
+		if (f != finished_callbacks.end()) {
+			to_call.emplace_back(std::move(f->second));
+			finished_callbacks.erase(f);
+		}
+	}
+
+	if (finished_overflow.exchange(false, std::memory_order_relaxed)) {
+		//some events were dropped; check every sound that is waiting on a callback instead:
+		for (auto f = finished_callbacks.begin(); f != finished_callbacks.end(); /* later */) {
+			PlayingSample sample;
+			sample.index = uint32_t(f->first >> 32);
+			sample.generation = uint32_t(f->first);
+			if (sample.stopped()) {
+				to_call.emplace_back(std::move(f->second));
+				f = finished_callbacks.erase(f);
+			} else {
+				++f;
+			}
+		}
+	}
+
+	for (auto &callback : to_call) {
+		callback();
 	}
-	Sound::unlock();
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+	Command command;
+	command.type = Command::SetListener;
+	command.value = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.right = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.right = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	command.ramp = ramp;
+	push_command(command);
 }
 
 //------------------------ internals --------------------------------
@@ -251,34 +1584,56 @@ void compute_pan_from_listener_and_position(
 	}
 }
 
-//helper: ramp updates...
-constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
+//helper: 3D distance attenuation alone (as above, without the panning), for binaural voices:
+float compute_attenuation(
+	glm::vec3 const &listener_position,
+	glm::vec3 const &source_position,
+	float source_half_radius
+	) {
+	float distance = glm::length(source_position - listener_position);
+	return 1.0f / (1.0f + (distance / source_half_radius));
+}
+
+//helper: direction from the listener to a source, in listener space (x = right, y = ahead, z = up; see hrtf.hpp):
+// (not normalized; listener's up is taken to be +z)
+glm::vec3 compute_listener_direction(
+	glm::vec3 const &listener_position,
+	glm::vec3 const &listener_right,
+	glm::vec3 const &source_position
+	) {
+	glm::vec3 to = source_position - listener_position;
+	glm::vec3 const up = glm::vec3(0.0f, 0.0f, 1.0f);
+	glm::vec3 ahead = glm::cross(up, listener_right);
+	return glm::vec3(glm::dot(to, listener_right), glm::dot(to, ahead), glm::dot(to, up));
+}
+
+//helper: ramp updates, by 'ramp_step' seconds (the length of a block)...
 
 //helper: ...for single values:
-void step_value_ramp(Sound::Ramp< float > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_value_ramp(Sound::Ramp< float > &ramp, float ramp_step) {
+	if (ramp.ramp < ramp_step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value += (RAMP_STEP / ramp.ramp) * (ramp.target - ramp.value);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value += (ramp_step / ramp.ramp) * (ramp.target - ramp.value);
+		ramp.ramp -= ramp_step;
 	}
 }
 
 //helper: ...for 3D positions:
-void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp, float ramp_step) {
+	if (ramp.ramp < ramp_step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value = glm::mix(ramp.value, ramp.target, RAMP_STEP / ramp.ramp);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value = glm::mix(ramp.value, ramp.target, ramp_step / ramp.ramp);
+		ramp.ramp -= ramp_step;
 	}
 }
 
 //helper: ...for 3D directions:
-void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp, float ramp_step) {
+	if (ramp.ramp < ramp_step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
@@ -302,16 +1657,354 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 		float angle = std::acos(glm::clamp(glm::dot(ramp.value, ramp.target), -1.0f, 1.0f));
 
 		//figure out new target value by moving angle toward target:
-		angle *= (ramp.ramp - RAMP_STEP) / ramp.ramp;
+		angle *= (ramp.ramp - ramp_step) / ramp.ramp;
 
 		ramp.value = ramp.target * std::cos(angle) + perp * std::sin(angle);
-		ramp.ramp -= RAMP_STEP;
+		ramp.ramp -= ramp_step;
 	}
 }
 
 
+namespace {
+
+//helper: stop a voice by fading it out:
+void fade_out(Voice &voice, float ramp) {
+	if (!voice.stopping) {
+		voice.stopping = true;
+		voice.volume.target = 0.0f;
+		voice.volume.ramp = ramp;
+	} else {
+		voice.volume.ramp = std::min(voice.volume.ramp, ramp);
+	}
+}
+
+//helper: end a voice that is being mixed, making its handles stale:
+// (if the game thread stole the voice in the meantime, it stays reserved for the pending Play)
+void finish_voice(Voice &voice) {
+	assert(voice.active);
+	voice.active = false;
+	if (voice.stream != OpusStream::None) {
+		OpusStream::release(voice.stream);
+		voice.stream = OpusStream::None;
+	}
+	uint32_t slot = voice.slot.load(std::memory_order_relaxed);
+	uint32_t next;
+	do {
+		uint32_t state = slot & SLOT_STATE_MASK;
+		next = (slot & ~SLOT_STATE_MASK) + SLOT_GENERATION_STEP;
+		next |= (state == SlotStolen ? SlotStolen : SlotFree);
+	} while (!voice.slot.compare_exchange_weak(slot, next, std::memory_order_acq_rel));
+
+	//let the game thread know:
+	Finished event;
+	event.index = uint32_t(&voice - voices.get());
+	event.generation = slot & ~SLOT_STATE_MASK;
+	if (!finished.push(event)) finished_overflow.store(true, std::memory_order_relaxed);
+}
+
+void apply_command(Command &command) {
+	if (command.type == Command::SetGlobalVolume) {
+		Sound::volume.set(command.value.x, command.ramp);
+		return;
+	} else if (command.type == Command::SetBusVolume) {
+		assert(command.index < bus_count);
+		buses[command.index].volume.set(command.value.x, command.ramp);
+		return;
+	} else if (command.type == Command::SetListener) {
+		Sound::listener.position.set(command.value, command.ramp);
+		Sound::listener.right.set(command.right, command.ramp);
+		return;
+	} else if (command.type == Command::StopAll) {
+		for (uint32_t v = 0; v < voice_count; ++v) {
+			if (voices[v].active) fade_out(voices[v], command.ramp);
+		}
+		return;
+	}
+
+	assert(command.index < voice_count);
+	Voice &voice = voices[command.index];
+
+	if (command.type == Command::Play) {
+		if (voice.active) finish_voice(voice); //voice was stolen
+		voice.active = true;
+		voice.data = command.data;
+		voice.size = command.size;
+		voice.stride = command.stride;
+		voice.encoding = command.encoding;
+		voice.stream = command.stream;
+		voice.i = 0;
+		voice.frac = 0;
+		voice.rate = Sound::Ramp< float >(1.0f);
+		voice.start_frame = command.start_frame;
+		voice.loop = command.loop;
+		voice.stopping = false;
+		voice.volume = Sound::Ramp< float >(command.volume);
+		voice.pan = Sound::Ramp< float >(command.pan);
+		voice.position = Sound::Ramp< glm::vec3 >(command.value);
+		voice.half_volume_radius = Sound::Ramp< float >(command.half_volume_radius);
+		voice.priority = 0.0f;
+		voice.bus = command.bus;
+		if (!convolvers.empty()) convolvers[command.index].reset();
+		uint32_t slot = voice.slot.load(std::memory_order_relaxed);
+		assert((slot & ~SLOT_STATE_MASK) == command.generation);
+		voice.slot.store((slot & ~SLOT_STATE_MASK) | SlotPlaying, std::memory_order_release);
+		return;
+	}
+
+	//ignore commands for voices that have already finished:
+	if (!voice.active || (voice.slot.load(std::memory_order_relaxed) & ~SLOT_STATE_MASK) != command.generation) return;
+
+	//'2D' voices have a pan value, '3D' voices have NaN for pan:
+	bool is_2D = voice.pan.value == voice.pan.value;
+
+	switch (command.type) {
+		case Command::Stop:
+			fade_out(voice, command.ramp);
+			break;
+		case Command::SetVolume:
+			if (!voice.stopping) voice.volume.set(command.value.x, command.ramp);
+			break;
+		case Command::SetPan:
+			if (is_2D) voice.pan.set(command.value.x, command.ramp);
+			break;
+		case Command::SetPosition:
+			if (!is_2D) voice.position.set(command.value, command.ramp);
+			break;
+		case Command::SetHalfVolumeRadius:
+			if (!is_2D) voice.half_volume_radius.set(command.value.x, command.ramp);
+			break;
+		case Command::SetRate:
+			voice.rate.set(command.value.x, command.ramp);
+			break;
+		case Command::SetPriority:
+			voice.priority = command.value.x;
+			break;
+		default:
+			assert(0 && "handled above");
+			break;
+	}
+}
+
+//helper: decode 'count' values of a voice's data, starting at index 'from', into 'dst' for the resampler.
+// looping voices wrap around (so a loop point is filtered seamlessly); others read zeros outside the data:
+void gather_source(Voice const &voice, int64_t from, uint32_t count, float *dst) {
+	int64_t size = voice.size;
+	int64_t j = from;
+	if (voice.loop) {
+		j = ((j % size) + size) % size;
+		while (count > 0) {
+			uint32_t run = uint32_t(std::min< int64_t >(count, size - j));
+			decode_samples(voice.data, voice.encoding, voice.stride, size_t(j), run, dst);
+			dst += run;
+			count -= run;
+			j += run;
+			if (j == size) j = 0;
+		}
+	} else {
+		for (; count > 0 && j < 0; --count, ++j) {
+			*(dst++) = 0.0f;
+		}
+		if (count > 0 && j < size) {
+			uint32_t run = uint32_t(std::min< int64_t >(count, size - j));
+			decode_samples(voice.data, voice.encoding, voice.stride, size_t(j), run, dst);
+			dst += run;
+			count -= run;
+		}
+		std::fill(dst, dst + count, 0.0f);
+	}
+}
+
+//helper: play a voice's part of a block -- mixing it into 'out' (interleaved stereo, mix_frames frames) if
+// given, or, for virtual voices, only moving it along so it picks up in the right place once it's audible again.
+// returns true if the voice ran out of data or has faded out (the caller finishes it -- see finish_voice).
+// (runs on mixing worker threads too, so touches nothing but the voice and 'out')
+bool play_voice(Voice &voice, uint32_t mix_frames, float *out) {
+	uint32_t first = voice.block_first;
+
+	if (voice.stream != OpusStream::None) {
+		//streaming voices read whatever the decoder has ready (virtual ones too, to keep their place):
+		float decoded[MAX_MIX_SAMPLES];
+		bool ended = false;
+		uint32_t count = OpusStream::read(voice.stream, decoded, mix_frames - first, &ended);
+		if (out) mix_mono_to_stereo(decoded, count, out + 2 * first, voice.gain_l + first * voice.gain_step_l, voice.gain_r + first * voice.gain_step_r, voice.gain_step_l, voice.gain_step_r);
+		return ended || (voice.stopping && voice.volume.value == 0.0f);
+	}
+
+	assert(voice.i < voice.size);
+
+	float rate = voice.block_rate;
+	if (rate != 1.0f || voice.frac != 0) {
+		//voices not playing at 1.0x go through the polyphase resampler:
+		uint64_t step = uint64_t(double(rate) * 4294967296.0);
+		uint64_t position = (uint64_t(voice.i) << 32) | voice.frac;
+		uint64_t end = uint64_t(voice.size) << 32;
+
+		uint32_t count = mix_frames - first;
+		if (!voice.loop) {
+			//(non-looping voices stop once the read position passes the end)
+			count = uint32_t(std::min< uint64_t >(count, (end - position + step - 1) / step));
+		}
+		assert(count > 0);
+
+		if (out) {
+			static thread_local float source[MAX_MIX_SAMPLES * uint32_t(MAX_RATE) + RESAMPLE_TAPS + 1];
+			float resampled[MAX_MIX_SAMPLES];
+
+			//gather the source values the filter will read, then resample from them:
+			int64_t window_begin = int64_t(position >> 32) - int64_t(RESAMPLE_TAPS / 2 - 1);
+			uint32_t window = uint32_t(((position + uint64_t(count - 1) * step) >> 32) - (position >> 32)) + RESAMPLE_TAPS;
+			gather_source(voice, window_begin, window, source);
+			resample_polyphase(source, position & 0xffffffffULL, step, resample_filter(rate), count, resampled);
+
+			float f = float(first);
+			mix_mono_to_stereo(
+				resampled, count,
+				out + 2 * first,
+				voice.gain_l + f * voice.gain_step_l, voice.gain_r + f * voice.gain_step_r,
+				voice.gain_step_l, voice.gain_step_r
+			);
+		}
+
+		position += uint64_t(count) * step;
+		if (voice.loop) position %= end;
+		if (position >= end) {
+			voice.i = voice.size; //finished
+			voice.frac = 0;
+		} else {
+			voice.i = uint32_t(position >> 32);
+			voice.frac = uint32_t(position);
+		}
+
+		return voice.i >= voice.size
+		    || (voice.stopping && voice.volume.value == 0.0f); //sample has finished
+	}
+
+	//mix in loop-free spans, each handled by the (vectorized) block kernel:
+	for (uint32_t mixed = first; mixed < mix_frames; /* later */) {
+		uint32_t span = std::min(mix_frames - mixed, uint32_t(voice.size - voice.i));
+		if (out) {
+			float f = float(mixed);
+			float const *span_data;
+			float decoded[MAX_MIX_SAMPLES];
+			if (voice.encoding == Sound::Sample::Float && voice.stride == 1) {
+				span_data = static_cast< float const * >(voice.data) + voice.i;
+			} else {
+				//other encodings (and strided views) are decoded into a contiguous block for the kernel:
+				decode_samples(voice.data, voice.encoding, voice.stride, voice.i, span, decoded);
+				span_data = decoded;
+			}
+			mix_mono_to_stereo(
+				span_data, span,
+				out + 2 * mixed,
+				voice.gain_l + f * voice.gain_step_l, voice.gain_r + f * voice.gain_step_r,
+				voice.gain_step_l, voice.gain_step_r
+			);
+		}
+		mixed += span;
+
+		//update position in sample:
+		voice.i += span;
+		if (voice.i == voice.size) {
+			if (voice.loop) {
+				voice.i = 0;
+			} else {
+				break;
+			}
+		}
+	}
+
+	return voice.i >= voice.size
+	    || (voice.stopping && voice.volume.value == 0.0f); //sample has finished
+}
+
+//helper: mix a real voice into 'out' -- through its HRTF convolver, if it is binaural this block.
+// (when a binaural voice finishes, the tail of the filter past the end of the block is dropped)
+bool mix_voice(Voice &voice, uint32_t mix_frames, float *out) {
+	if (!voice.binaural) return play_voice(voice, mix_frames, out);
+
+	//play the voice (attenuated, not panned) into the left channel of a scratch block, then filter that:
+	static thread_local float dry[2 * MAX_MIX_SAMPLES];
+	std::fill(dry, dry + 2 * mix_frames, 0.0f);
+	bool done = play_voice(voice, mix_frames, dry);
+	float mono[MAX_MIX_SAMPLES];
+	for (uint32_t s = 0; s < mix_frames; ++s) {
+		mono[s] = dry[2*s];
+	}
+	convolvers[&voice - voices.get()].process(*hrtf_set, mono, mix_frames, voice.direction_from, voice.direction_to, out);
+	return done;
+}
+
+//Mixing real voices across threads (see Sound::set_mix_threads):
+// the real voices are split into contiguous chunks (in voice order); chunk 0 is mixed straight into the output,
+// and each other chunk into its own buffer, which is then added to the output in chunk order --
+// so for a given thread count the result doesn't depend on which thread mixed what, or when.
+struct MixJob {
+	uint32_t mix_frames = 0;
+	uint32_t const *real = nullptr; //real voices, in voice order
+	uint32_t real_count = 0;
+	uint32_t chunks = 0;
+	float *output = nullptr;
+};
+
+void mix_chunk(void *context, uint32_t chunk) {
+	MixJob const &job = *static_cast< MixJob const * >(context);
+	float *out = job.output;
+	if (chunk != 0) {
+		out = chunk_buffers.get() + size_t(chunk - 1) * 2 * MAX_MIX_SAMPLES;
+		std::fill(out, out + 2 * job.mix_frames, 0.0f);
+	}
+	uint32_t begin = chunk * job.real_count / job.chunks;
+	uint32_t end = (chunk + 1) * job.real_count / job.chunks;
+	for (uint32_t r = begin; r < end; ++r) {
+		Voice &voice = voices[job.real[r]];
+		voice.finished = mix_voice(voice, job.mix_frames, out);
+	}
+}
+
+//helper: mix real voices (listed in voice order) into 'out' -- spread over the mixing workers if there are enough:
+void mix_voices(uint32_t const *real, uint32_t count, uint32_t mix_frames, float *out) {
+	uint32_t chunks = 1;
+	if (mix_workers) {
+		chunks = std::max(1U, std::min(mix_workers->size() + 1, count / MIN_VOICES_PER_CHUNK));
+	}
+	if (chunks == 1) {
+		for (uint32_t r = 0; r < count; ++r) {
+			Voice &voice = voices[real[r]];
+			voice.finished = mix_voice(voice, mix_frames, out);
+		}
+	} else {
+		MixJob job;
+		job.mix_frames = mix_frames;
+		job.real = real;
+		job.real_count = count;
+		job.chunks = chunks;
+		job.output = out;
+		mix_workers->run(mix_chunk, &job, chunks);
+		for (uint32_t c = 1; c < chunks; ++c) {
+			add_block(chunk_buffers.get() + size_t(c - 1) * 2 * MAX_MIX_SAMPLES, 2 * mix_frames, out);
+		}
+	}
+}
+
+//helper: add stereo 'block' into 'out', with gain ramping from 'start' to 'end' over the block:
+void mix_stereo(float const *block, uint32_t mix_frames, float start, float end, float *out) {
+	if (start == 1.0f && end == 1.0f) {
+		add_block(block, 2 * mix_frames, out);
+		return;
+	}
+	float step = (end - start) / mix_frames;
+	for (uint32_t s = 0; s < mix_frames; ++s) {
+		float gain = start + float(s) * step;
+		out[2*s+0] += gain * block[2*s+0];
+		out[2*s+1] += gain * block[2*s+1];
+	}
+}
+
+} //namespace
+
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void mix_audio(void *, Uint8 *buffer_, int len) {
+	auto callback_start = std::chrono::steady_clock::now();
 	assert(buffer_); //should always have some audio buffer
 
 	struct LR {
@@ -319,120 +2012,347 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		float r;
 	};
 	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
+	//blocks are whatever size the device was opened with (see Sound::Latency):
+	uint32_t const mix_frames = uint32_t(len) / sizeof(LR);
+	assert(mix_frames >= MIN_MIX_SAMPLES && mix_frames <= MAX_MIX_SAMPLES && mix_frames * sizeof(LR) == uint32_t(len));
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
+	//ramps move along by one block's worth of time:
+	float const ramp_step = float(mix_frames) / float(AUDIO_RATE);
+
 	//zero the output buffer:
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < mix_frames; ++s) {
 		buffer[s].l = 0.0f;
 		buffer[s].r = 0.0f;
 	}
 
+	//apply changes queued by the game thread since the last block:
+	apply_commands();
+
+	uint64_t block_frame = next_block_frame.load(std::memory_order_relaxed);
+
 	//update global values:
 	float start_volume = Sound::volume.value;
 	glm::vec3 start_position =  Sound::listener.position.value;
 	glm::vec3 start_right =  Sound::listener.right.value;
 
-	step_value_ramp(Sound::volume);
-	step_position_ramp( Sound::listener.position);
-	step_direction_ramp( Sound::listener.right);
+	step_value_ramp(Sound::volume, ramp_step);
+	step_position_ramp(Sound::listener.position, ramp_step);
+	step_direction_ramp(Sound::listener.right, ramp_step);
 
 	float end_volume = Sound::volume.value;
 	glm::vec3 end_position =  Sound::listener.position.value;
 	glm::vec3 end_right =  Sound::listener.right.value;
 
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	//Work out each voice's gains over the block (stepping its ramps), and how audible that makes it:
+	float const threshold = virtual_threshold.load(std::memory_order_relaxed);
+	uint32_t audible_count = 0;
+	for (uint32_t v = 0; v < voice_count; ++v) {
+		Voice &voice = voices[v];
+		if (!voice.active) continue;
+
+		//3D voices are filtered by the HRTF rather than panned, if there is one:
+		voice.binaural = (hrtf_set && !(voice.pan.value == voice.pan.value));
 
 		//Figure out sample panning/volume at start...
 		LR start_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+		if (voice.binaural) {
+			//binaural: attenuation only (carried in the left gain; see mix_voice) and direction
+			start_pan.l = compute_attenuation(start_position, voice.position.value, voice.half_volume_radius.value);
+			start_pan.r = 0.0f;
+			voice.direction_from = compute_listener_direction(start_position, start_right, voice.position.value);
+
+			step_position_ramp(voice.position, ramp_step);
+			step_value_ramp(voice.half_volume_radius, ramp_step);
+		} else if (!(voice.pan.value == voice.pan.value)) {
 			//3D panning
 			compute_pan_from_listener_and_position(
 				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
+				voice.position.value,
+				voice.half_volume_radius.value,
 				&start_pan.l, &start_pan.r);
 
-			step_position_ramp(playing_sample.position);
-			step_value_ramp(playing_sample.half_volume_radius);
+			step_position_ramp(voice.position, ramp_step);
+			step_value_ramp(voice.half_volume_radius, ramp_step);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+			compute_pan_weights(voice.pan.value, &start_pan.l, &start_pan.r);
 
-			step_value_ramp(playing_sample.pan);
+			step_value_ramp(voice.pan, ramp_step);
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
+		start_pan.l *= start_volume * voice.volume.value;
+		start_pan.r *= start_volume * voice.volume.value;
 
-		step_value_ramp(playing_sample.volume);
+		step_value_ramp(voice.volume, ramp_step);
 
 		//..and end of the mix period:
 		LR end_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+		if (voice.binaural) {
+			end_pan.l = compute_attenuation(end_position, voice.position.value, voice.half_volume_radius.value);
+			end_pan.r = 0.0f;
+			voice.direction_to = compute_listener_direction(end_position, end_right, voice.position.value);
+		} else if (!(voice.pan.value == voice.pan.value)) {
 			//3D panning
 			compute_pan_from_listener_and_position(
 				end_position, end_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
+				voice.position.value,
+				voice.half_volume_radius.value,
 				&end_pan.l, &end_pan.r);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			compute_pan_weights(voice.pan.value, &end_pan.l, &end_pan.r);
 		}
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+		end_pan.l *= end_volume * voice.volume.value;
+		end_pan.r *= end_volume * voice.volume.value;
 
 		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
-
-		assert(playing_sample.i < playing_sample.data.size());
-
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
-
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
-				} else {
-					break;
-				}
+		voice.gain_l = start_pan.l;
+		voice.gain_r = start_pan.r;
+		voice.gain_step_l = (end_pan.l - start_pan.l) / mix_frames;
+		voice.gain_step_r = (end_pan.r - start_pan.r) / mix_frames;
+		voice.audibility = std::max(
+			std::max(std::abs(start_pan.l), std::abs(start_pan.r)),
+			std::max(std::abs(end_pan.l), std::abs(end_pan.r))
+		);
+		voice.real = false;
+
+		//playback rate is held for the block (and ramps from block to block):
+		voice.block_rate = voice.rate.value;
+		step_value_ramp(voice.rate, ramp_step);
+
+		//voices scheduled with play_at wait (silently) for their start frame:
+		voice.block_first = 0;
+		if (voice.start_frame > block_frame) {
+			if (voice.start_frame - block_frame >= mix_frames) {
+				if (voice.stopping && voice.volume.value == 0.0f) finish_voice(voice); //stopped before it started
+				continue;
 			}
+			voice.block_first = uint32_t(voice.start_frame - block_frame);
+		}
+
+		if (voice.audibility >= threshold) audible_voices[audible_count++] = v;
+	}
+
+	//Mix (at most real_voice_limit of) the audible voices -- highest priority first, then loudest:
+	uint32_t max_real = real_voice_limit.load(std::memory_order_relaxed);
+	if (audible_count > max_real) {
+		std::nth_element(audible_voices.get(), audible_voices.get() + max_real, audible_voices.get() + audible_count, [](uint32_t a, uint32_t b) {
+			if (voices[a].priority != voices[b].priority) return voices[a].priority > voices[b].priority;
+			return voices[a].audibility > voices[b].audibility;
+		});
+		audible_count = max_real;
+	}
+	for (uint32_t a = 0; a < audible_count; ++a) {
+		voices[audible_voices[a]].real = true;
+	}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+	//move virtual voices along, and list the real ones (in voice order, reusing 'audible_voices'):
+	// (voices sit in one contiguous array, so this is a linear walk)
+	uint32_t voices_mixed = 0;
+	uint32_t voices_virtual = 0;
+	for (uint32_t v = 0; v < voice_count; ++v) {
+		Voice &voice = voices[v];
+		if (!voice.active) continue;
+		if (voice.start_frame > block_frame && voice.start_frame - block_frame >= mix_frames) continue; //(still waiting)
+		if (voice.real) {
+			audible_voices[voices_mixed++] = v;
+		} else {
+			++voices_virtual;
+			if (voice.binaural) convolvers[v].reset(); //(its input history will be stale once it's audible again)
+			if (play_voice(voice, mix_frames, nullptr)) finish_voice(voice);
 		}
+	}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+	//group the real voices by bus (keeping voice order within each bus):
+	uint32_t bus_begin[MAX_BUSES + 1] = {};
+	for (uint32_t r = 0; r < voices_mixed; ++r) {
+		++bus_begin[voices[audible_voices[r]].bus + 1];
+	}
+	for (uint32_t b = 0; b < MAX_BUSES; ++b) {
+		bus_begin[b + 1] += bus_begin[b];
+	}
+	uint32_t bus_end[MAX_BUSES];
+	std::copy(bus_begin, bus_begin + MAX_BUSES, bus_end);
+	for (uint32_t r = 0; r < voices_mixed; ++r) {
+		uint32_t v = audible_voices[r];
+		bus_voices[bus_end[voices[v].bus]++] = v;
+	}
+
+	//add audio from each real voice into its bus (MasterBus being the output buffer itself):
+	float *output = &buffer[0].l;
+	for (uint32_t b = 0; b < bus_count; ++b) {
+		BusState &bus = buses[b];
+		uint32_t count = bus_end[b] - bus_begin[b];
+		bus.used = (b == Sound::MasterBus || count > 0);
+		if (count == 0) continue;
+		float *out = (b == Sound::MasterBus ? output : bus.block);
+		if (out != output) std::fill(out, out + 2 * mix_frames, 0.0f);
+		mix_voices(bus_voices.get() + bus_begin[b], count, mix_frames, out);
+	}
+
+	//run each bus's effects and mix it into its parent, children first:
+	for (uint32_t b = bus_count - 1; b > 0; --b) {
+		BusState &bus = buses[b];
+		float start_gain = bus.volume.value;
+		step_value_ramp(bus.volume, ramp_step);
+		float end_gain = bus.volume.value;
+
+		if (!bus.used) {
+			if (bus.effect_count == 0) continue; //(nothing to add)
+			//effects might still have a tail to play out:
+			std::fill(bus.block, bus.block + 2 * mix_frames, 0.0f);
+		}
+		for (uint32_t e = 0; e < bus.effect_count; ++e) {
+			bus.effects[e]->process(bus.block, mix_frames);
+		}
+
+		BusState &parent = buses[bus.parent];
+		float *into = (bus.parent == Sound::MasterBus ? output : parent.block);
+		if (!parent.used) {
+			std::fill(into, into + 2 * mix_frames, 0.0f);
+			parent.used = true;
+		}
+		mix_stereo(bus.block, mix_frames, start_gain, end_gain, into);
+	}
+	{ //MasterBus works on the output in place:
+		BusState &master = buses[Sound::MasterBus];
+		for (uint32_t e = 0; e < master.effect_count; ++e) {
+			master.effects[e]->process(output, mix_frames);
+		}
+		float start_gain = master.volume.value;
+		step_value_ramp(master.volume, ramp_step);
+		float end_gain = master.volume.value;
+		if (!(start_gain == 1.0f && end_gain == 1.0f)) {
+			float step = (end_gain - start_gain) / mix_frames;
+			for (uint32_t s = 0; s < mix_frames; ++s) {
+				float gain = start_gain + float(s) * step;
+				output[2*s+0] *= gain;
+				output[2*s+1] *= gain;
+			}
+		}
+	}
+	//publish the finished block to the tap, if anyone is listening:
+	// (whole blocks or nothing, so the reader never sees a partial block)
+	if (tap_on.load(std::memory_order_relaxed)) {
+		if (tap.slots.size() - tap.size() >= 2 * mix_frames) {
+			tap.push_n(output, 2 * mix_frames);
 		} else {
-			++si;
+			callback_stats.tap_dropped.fetch_add(1, std::memory_order_relaxed);
 		}
 	}
 
+	//(finishing queues events for the game thread, so happens here, on this thread, in voice order)
+	for (uint32_t r = 0; r < voices_mixed; ++r) {
+		Voice &voice = voices[audible_voices[r]];
+		if (voice.finished) finish_voice(voice);
+	}
+
+	next_block_frame.store(block_frame + mix_frames, std::memory_order_release);
+
+	record_callback(callback_start, voices_mixed, voices_virtual, mix_frames);
+
 	/*//DEBUG: report output power:
 	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < mix_frames; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
+	std::cout << "Max Power: " << std::sqrt(max_power) << "; active voices: " << std::count_if(voices.get(), voices.get() + voice_count, [](Voice const &voice){ return voice.active; }) << std::endl; //DEBUG
 	*/
 
 }
 
+void device_audio(void *, Uint8 *buffer_, int len) {
+	auto callback_start = std::chrono::steady_clock::now();
+
+	fill_device_buffer(buffer_, len);
+
+	//Did the device (probably) run dry? -- if this callback started more than half a buffer late,
+	// or took longer than the buffer lasts, then the device likely played out everything it had queued:
+	uint64_t budget = device_buffer_ns.load(std::memory_order_relaxed);
+	uint64_t ns = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - callback_start).count());
+	bool late = false;
+	if (device_have_previous) {
+		uint64_t period = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(callback_start - device_previous_start).count());
+		late = (period > budget + budget / 2);
+	}
+	device_previous_start = callback_start;
+	device_have_previous = true;
+	if (late || ns > budget) callback_stats.underruns.fetch_add(1, std::memory_order_relaxed);
+	raise_max(callback_stats.device_max_ns, ns);
+}
+
+//helper: fill a device buffer with mixed audio (device callback, or the mixer thread):
+void fill_device_buffer(Uint8 *buffer_, int len) {
+	uint32_t const mix_frames = mix_samples.load(std::memory_order_relaxed);
+	if (output.device_rate == AUDIO_RATE && len == int(mix_frames * 2 * sizeof(float))) {
+		//the usual case -- the device takes mixed blocks as-is:
+		mix_audio(nullptr, buffer_, len);
+	} else {
+		resample_to_device(buffer_, len, mix_frames);
+	}
+}
+
+void queued_audio(void *, Uint8 *buffer_, int len) {
+	float *out = reinterpret_cast< float * >(buffer_);
+	uint32_t count = uint32_t(len) / sizeof(float);
+	uint32_t got = mixer.queue.pop_n(out, count);
+	if (got < count) {
+		//the mixer thread fell behind -- play silence rather than wait for it:
+		std::fill(out + got, out + count, 0.0f);
+		callback_stats.underruns.fetch_add(1, std::memory_order_relaxed);
+	}
+	mixer.wake.notify_one();
+}
 
+//helper: fill a device buffer at the device's rate from (resampled) mixed blocks of 'mix_frames' frames:
+void resample_to_device(Uint8 *buffer_, int len, uint32_t mix_frames) {
+
+	float *out = reinterpret_cast< float * >(buffer_);
+	uint32_t frames = uint32_t(len) / (2 * sizeof(float));
+
+	static float mixed[2 * MAX_MIX_SAMPLES];
+	static float resampled_l[MAX_MIX_SAMPLES];
+	static float resampled_r[MAX_MIX_SAMPLES];
+
+	while (frames > 0) {
+		//how many device frames can be made from the mixed frames on hand?
+		uint32_t available = 0;
+		if (output.pending_count >= RESAMPLE_TAPS) {
+			uint64_t limit = uint64_t(output.pending_count - RESAMPLE_TAPS + 1) << 32;
+			if (output.position < limit) {
+				available = uint32_t(std::min< uint64_t >(MAX_MIX_SAMPLES, (limit - output.position + output.step - 1) / output.step));
+			}
+		}
+
+		if (available == 0) {
+			//drop frames that have been fully used, then mix another block:
+			uint32_t used = uint32_t(output.position >> 32);
+			for (auto &channel : output.pending) {
+				std::copy(channel.begin() + used, channel.begin() + output.pending_count, channel.begin());
+			}
+			output.pending_count -= used;
+			output.position -= uint64_t(used) << 32;
+
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(mixed), int(mix_frames * 2 * sizeof(float)));
+			assert(output.pending_count + mix_frames <= output.pending[0].size());
+			for (uint32_t s = 0; s < mix_frames; ++s) {
+				output.pending[0][output.pending_count + s] = mixed[2*s+0];
+				output.pending[1][output.pending_count + s] = mixed[2*s+1];
+			}
+			output.pending_count += mix_frames;
+			continue;
+		}
+
+		uint32_t count = std::min(frames, available);
+		resample_polyphase(output.pending[0].data(), output.position, output.step, output.filter, count, resampled_l);
+		resample_polyphase(output.pending[1].data(), output.position, output.step, output.filter, count, resampled_r);
+		for (uint32_t s = 0; s < count; ++s) {
+			out[2*s+0] = resampled_l[s];
+			out[2*s+1] = resampled_r[s];
+		}
+		out += 2 * count;
+		frames -= count;
+		output.position += uint64_t(count) * output.step;
+	}
+}
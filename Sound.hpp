@@ -2,27 +2,80 @@
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <string>
 #include <cmath>
+#include <limits>
+#include <array>
+#include <functional>
 
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
 
+struct HRTF; //(see hrtf.hpp)
+struct Effect; //(see bus_effects.hpp)
+
 namespace Sound {
 
 //Sample objects hold mono (one-channel) audio.
+//  The audio lives in an immutable, reference-counted buffer: copying a Sample (or taking a
+//  slice() of one) shares the data instead of duplicating it, and sounds that are playing keep
+//  their data alive, so it is fine to destroy or move Samples while they are being played.
+//  Samples can stay resident in a smaller encoding, which the mixer decodes as it plays.
 struct Sample {
+	//How sample data is stored:
+	enum Encoding : uint8_t {
+		Float, //32-bit float (4 bytes per sample)
+		Int16, //16-bit signed integer PCM (2 bytes per sample)
+		ADPCM, //4-bit IMA ADPCM in independently-decodable blocks (about 0.56 bytes per sample; see adpcm.hpp)
+	};
+
 	//Load from a '.wav' or '.opus' file.
 	//  will warn and convert if sound is not already 48kHz mono:
-	Sample(std::string const &filename);
+	Sample(std::string const &filename, Encoding encoding = Float);
 	
-	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	//Directly supply an audio buffer (it is copied, and converted to 'encoding'):
+	Sample(std::vector< float > const &data, Encoding encoding = Float);
+
+	//View memory owned by something else (e.g., a memory-mapped SoundBank) without copying it:
+	//  'owner' keeps the memory alive; samples are begin[0], begin[stride], ..., begin[(length-1)*stride].
+	Sample(std::shared_ptr< void const > const &owner, float const *begin, size_t length, uint32_t stride = 1);
+	Sample(std::shared_ptr< void const > const &owner, int16_t const *begin, size_t length, uint32_t stride = 1);
+	//  (any encoding; for ADPCM 'begin' points at the first block and stride must be 1)
+	Sample(std::shared_ptr< void const > const &owner, Encoding encoding, void const *begin, size_t length, uint32_t stride = 1);
+
+	//A Sample that views samples [begin,end) of this one (sharing its storage):
+	// (ADPCM samples can only be sliced at the start of a block)
+	Sample slice(size_t begin, size_t end) const;
+
+	//Decode samples [begin, begin + count) into 'out' as floats:
+	void decode(size_t begin, size_t count, float *out) const;
+
+	size_t size() const { return length; }
+
+	//Memory used by the sample data:
+	size_t bytes() const;
 
-	//sample data is stored as 48kHz, mono, floating-point:
-	std::vector< float > data;
+	//sample data is 48kHz and mono, viewed as (pointer, length, stride) in some encoding:
+	std::shared_ptr< void const > buffer; //points at the first sample (or ADPCM block); shares ownership of the storage
+	size_t length = 0; //number of samples
+	uint32_t stride = 1; //distance (in values) between samples; always 1 for ADPCM
+	Encoding encoding = Float;
+};
+
+//StreamingSample objects hold still-compressed '.opus' audio, which is decoded a little
+//  ahead of playback on a worker thread instead of all at once when loading.
+//  Use these for long sounds (music, narration) to save memory and load time.
+//  Only a few streaming sounds can play at once (see OpusStream::MaxStreams).
+struct StreamingSample {
+	//Load (but don't decode) an '.opus' file:
+	StreamingSample(std::string const &filename);
+
+	//the compressed file contents -- shared (like Sample::buffer) with any streams playing them,
+	// so a StreamingSample may be destroyed while it plays:
+	std::shared_ptr< std::vector< unsigned char > const > bytes;
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -48,9 +101,13 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+// 'PlayingSample' is a handle to a voice that is playing a sample.
+// Voices come from a fixed-size pool (see Sound::init); when a voice finishes -- or is
+// stolen to play something else because the pool is full -- its handles go stale,
+// stopped() starts returning true, and the functions below quietly do nothing.
+// (Finishing also queues an event -- see Sound::poll_events -- so there is no need to poll stopped().)
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
 	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
@@ -59,71 +116,216 @@ struct PlayingSample {
 	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
 	//set the half-volume radius (use only on "3D" playing sounds):
 	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	//set the playback rate (1.0 == normal speed, 2.0 == double speed and an octave up, ...):
+	// rates are clamped to [1/8, 4]. Only has an effect on (non-streaming) Samples.
+	void set_rate(float new_rate, float ramp = 1.0f / 60.0f);
+	//set the priority (default 0) used when more voices are audible than may be mixed (see set_virtual_voices):
+	// higher-priority voices are mixed first; the rest keep playing silently until there's room.
+	void set_priority(float new_priority);
 
-	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
+	//'stop' will fade sample out over 'ramp' seconds and then release its voice:
 	void stop(float ramp = 1.0f / 60.0f);
 
+	//was playback stopped (either by running out of sample, by stop(), or by having its voice stolen)?
+	// (always true for an empty handle)
+	bool stopped() const;
+
+	//call 'callback' (from Sound::poll_events, on the game thread) once playback stops:
+	// (replaces any earlier callback for this sound; an already-stopped sound gets called back at the next poll)
+	void on_finished(std::function< void() > const &callback);
+
+	bool operator==(PlayingSample const &other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(PlayingSample const &other) const { return !(*this == other); }
+
+	//does this handle refer to a voice at all? (default-constructed handles don't):
+	explicit operator bool() const { return index != ~0U; }
+
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	uint32_t index = ~0U; //voice in the pool
+	uint32_t generation = 0; //generation of that voice this handle was issued for
 };
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//Output latency -- how many frames are mixed per block, which is also the size of the device's buffer:
+// smaller blocks mean a sound starts sooner after play() (128 frames is ~2.7ms, 1024 is ~21.3ms),
+// but leave the mixer less slack before the device runs dry (crackles).
+//With 'adaptive' set, update_latency() doubles the block size after the device runs dry
+// and halves it again after a stretch of underrun-free playback with plenty of headroom.
+//With 'mixer_thread' set, blocks are mixed on a dedicated thread instead of in SDL's device callback:
+// the thread asks for real-time priority (where the system allows it), keeps the voice pool and the
+// sample data it plays locked in RAM, and stays 'ahead' device buffers ahead of the device, whose
+// callback then only copies. That adds 'ahead' buffers of latency, but a page fault or a late wakeup
+// only eats into the queued buffers instead of turning into a crackle.
+struct Latency {
+	uint32_t frames = 1024; //one of 128, 256, 512, or 1024
+	bool adaptive = false;
+	bool mixer_thread = false;
+	uint32_t ahead = 2; //1 .. 4 (mixer thread only)
+};
+
+//call Sound::init() from main.cpp before using any member functions
+// 'max_voices' sets the size of the voice pool (the most sounds that can play at once)
+// 'open_device' = false skips opening an audio device, for use with render_offline():
+// 'latency' sets the block size and backend (see above; will throw if frames or ahead is out of range):
+void init(uint32_t max_voices = 64, bool open_device = true, Latency latency = Latency());
+
+//current block size, in frames:
+uint32_t latency_frames();
+
+//Mix blocks with many voices on 'threads' threads (the audio callback plus threads - 1 workers; 1 = no workers):
+//  real voices are split into chunks of at least 16 voices, each mixed into its own buffer, and the buffers
+//  summed in a fixed order -- so for a given thread count, output doesn't depend on thread timing.
+//  (starts or stops the worker threads, so call from the game thread, not every frame)
+void set_mix_threads(uint32_t threads);
+
+//Virtual voices -- voices too quiet to hear aren't mixed, only moved along (so they pick up in the right place):
+//  a voice is audible for a block if its gain (volume x 3D attenuation x pan) reaches 'threshold' at either end
+//  of the block; at most 'max_real' audible voices are mixed per block (highest priority first, then loudest),
+//  and any others are virtual too. Defaults are a threshold of 1e-4 (-80dB) and no limit.
+void set_virtual_voices(float threshold, uint32_t max_real = ~0U);
+
+//Binaural 3D audio -- with an HRTF set, voices played with play_3D / loop_3D are filtered through
+//  head-related impulse responses for their direction (see hrtf.hpp) instead of being panned,
+//  and 3D attenuation is applied as usual. nullptr (the default) goes back to panning.
+//  Directions assume the listener's up is +z (so straight ahead is cross(up, right)).
+//  (allocates filter state for every voice, so call from the game thread, not every frame)
+void set_hrtf(std::shared_ptr< HRTF const > const &hrtf);
+
+//Buses -- every voice plays into a bus. Each block, each bus runs its chain of effects over what was
+//  mixed into it, applies its volume, and mixes the result into its parent bus, down to MasterBus
+//  (whose output is what plays). Effects run once per bus rather than once per voice, so their cost
+//  doesn't grow with the number of voices.
+//  MusicBus, SFXBus, and VoiceBus (children of MasterBus) always exist; add_bus makes more.
+typedef uint32_t Bus;
+constexpr Bus const MasterBus = 0; //"master"
+constexpr Bus const MusicBus = 1; //"music"
+constexpr Bus const SFXBus = 2; //"sfx"
+constexpr Bus const VoiceBus = 3; //"voice"
+
+//add a bus named 'name' that mixes into 'parent':
+// note: will throw if the name is taken, 'parent' doesn't exist, or there are already 16 buses.
+Bus add_bus(std::string const &name, Bus parent = MasterBus);
+
+//look up a bus by name:
+// note: will throw if there's no such bus.
+Bus find_bus(std::string const &name);
+
+//ramp a bus's volume (default 1.0):
+void set_bus_volume(Bus bus, float volume, float ramp = 1.0f / 60.0f);
+
+//append 'effect' to the end of a bus's effect chain (at most 8 per bus); clear_effects empties the chain:
+//  the effect is shared, so the caller can keep adjusting it (see bus_effects.hpp).
+//  note: will throw if the bus doesn't exist or its chain is full.
+void add_effect(Bus bus, std::shared_ptr< Effect > const &effect);
+void clear_effects(Bus bus);
+
+//Call 'Sound::update_latency' once per frame (from the game thread) when using adaptive latency:
+//  changing the block size means reopening the audio device, so this is done here rather than in the callback.
+//  (the size only changes while no sounds are playing -- a grow waits for the current ones to finish --
+//   since reopening drops whatever the device had buffered)
+void update_latency();
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
-//Call 'Sound::play' to play a sample once.
+//Call 'Sound::play' to play a sample (or streaming sample) once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+//  if all voices are busy, the oldest stopping / non-looping / any voice is stolen for the new sound.
+//  the sound plays into 'bus' (see above).
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Bus bus = MasterBus
+);
+PlayingSample play(
+	StreamingSample const &sample,
+	float volume = 1.0f,
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Bus bus = MasterBus
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus bus = MasterBus
 );
+PlayingSample play_3D(
+	StreamingSample const &sample,
+	float volume,
+	glm::vec3 const &position,
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus bus = MasterBus
+);
+
+//The audio frame clock counts frames (at 48kHz) mixed since the program started.
+// frame_clock() is the first frame of the next block to be mixed: the earliest frame
+// that play_at() can start a sample on exactly.
+uint64_t frame_clock();
+
+//Call 'Sound::play_at' to start a sample exactly on audio frame 'start_frame'.
+//  (if that frame has already been mixed, the sample starts as soon as possible instead)
+//  the sample holds a voice while it waits to start:
+PlayingSample play_at(
+	Sample const &sample,
+	uint64_t start_frame,
+	float volume = 1.0f,
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Bus bus = MasterBus
+);
+
+//Call 'Sound::schedule_sequence' to queue samples to play one after another, starting on 'start_frame'.
+//  each item starts 'gap' seconds (rounded to the nearest frame) after the previous one ends.
+//  returns a handle for each item, in order:
+struct SequenceItem {
+	Sample const *sample = nullptr;
+	float gap = 0.0f; //silence before this sample, in seconds
+	float volume = 1.0f;
+	float pan = 0.0f;
+	Bus bus = MasterBus;
+};
+std::vector< PlayingSample > schedule_sequence(std::vector< SequenceItem > const &items, uint64_t start_frame);
+
+//Call 'Sound::poll_events' once per frame (from the game thread) to hear about sounds that finished:
+//  the audio thread queues an event (without locking) whenever a voice finishes; this drains the queue,
+//  appends each finished sound to '*finished' (if given), and runs the on_finished callbacks for them.
+//  (if the queue ever overflows, callbacks still run, but '*finished' may miss some sounds)
+void poll_events(std::vector< PlayingSample > *finished = nullptr);
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Bus bus = MasterBus
+);
+PlayingSample loop(
+	StreamingSample const &sample,
+	float volume = 1.0f,
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Bus bus = MasterBus
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus bus = MasterBus
+);
+PlayingSample loop_3D(
+	StreamingSample const &sample,
+	float volume,
+	glm::vec3 const &position,
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Bus bus = MasterBus
 );
 
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
+// (and, with set_hrtf, their direction relative to the listener)
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
 
@@ -140,9 +342,62 @@ void stop_all_samples();
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
+//mix the next 'frames' frames of audio into 'out' (interleaved stereo, so 2 * frames floats),
+// exactly as the audio callback would -- for benchmarks and tests that run without an audio device.
+// (best used after init(..., false); with a device open, this steals audio from the device)
+void render_offline(uint32_t frames, float *out);
+
+//Stats about the audio callback, for tracking down crackles (underruns):
+// the callback has one block (latency_frames() frames, ~21.3ms at 1024) of budget; if it takes longer, the device runs dry.
+struct Stats {
+	uint64_t callbacks = 0; //number of blocks mixed
+	uint64_t overruns = 0; //blocks that took longer than their budget to mix
+	uint64_t underruns = 0; //device callbacks that ran long or started late enough that the device probably ran dry (with a mixer thread: found the queue short)
+	uint32_t block_frames = 0; //current block size
+	float budget_ms = 0.0f; //time one block lasts
+	float last_ms = 0.0f; //time spent mixing the most recent block
+	float mean_ms = 0.0f; //...averaged over all blocks
+	float max_ms = 0.0f; //...longest
+	float min_headroom_ms = 0.0f; //smallest (budget - time spent); negative means an overrun
+	float max_late_ms = 0.0f; //longest a callback started after it was due (device or lock stalls)
+	uint32_t voices = 0; //voices mixed in the most recent block
+	uint32_t max_voices = 0; //...most in any block
+	uint32_t virtual_voices = 0; //voices only moved along (not mixed) in the most recent block
+	float lock_wait_max_ms = 0.0f; //longest time Sound::lock() waited for the callback
+	float lock_wait_total_ms = 0.0f; //total time Sound::lock() has waited
+	uint64_t tap_dropped = 0; //output blocks that didn't fit in the tap (see read_tap)
+	//mixer thread (see Latency::mixer_thread) -- null priority means there isn't one:
+	char const *mixer_priority = nullptr; //what the thread got: "SCHED_FIFO", "time-critical", "nice -10", or "normal"
+	uint32_t queued_frames = 0; //frames mixed ahead, waiting for the device
+	uint64_t locked_bytes = 0; //memory locked in RAM for the mixer (its own state, and sample data that is still around)
+
+	//histogram of time spent mixing, in tenths of the budget:
+	// bucket b < 10 counts blocks taking [b/10, (b+1)/10) of the budget; bucket 10 counts overruns.
+	static constexpr uint32_t Buckets = 11;
+	std::array< uint64_t, Buckets > histogram{};
+};
+
+//get the current stats (cheap; safe to call every frame):
+Stats stats();
+
+//start stats over from zero:
+void reset_stats();
+
+//Output tap -- when enabled, the callback copies each finished output block into a ring that
+//  the game thread can read for meters, scopes, spectra, etc. (see AudioScope.hpp):
+//  Blocks that don't fit (because the reader is behind) are dropped and counted (Stats::tap_dropped);
+//  the callback never waits on the reader.
+void set_tap(bool enabled); //(enabling throws away anything left over from before)
+bool tap_enabled();
+
+//append the interleaved stereo frames published since the last call to 'frames'; returns the number of frames added:
+// (only call from one thread -- usually the game thread)
+uint32_t read_tap(std::vector< float > *frames);
+
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// the set_*/stop/play/... functions *don't* use these -- they queue commands for the audio
+// callback through a lock-free ring instead, so the game thread never waits on the mixer.
+// You only need these if your code is modifying values directly:
 void lock();
 void unlock();
 
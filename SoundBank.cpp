@@ -0,0 +1,144 @@
+#include "SoundBank.hpp"
+#include "read_write_chunk.hpp"
+#include "adpcm.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+SoundBank::SoundBank(std::string const &filename) {
+	//--- map the file ---
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open sound bank '" + filename + "'.");
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of sound bank '" + filename + "'.");
+	}
+	mapping_size = size_t(size.QuadPart);
+	HANDLE file_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file); //(the mapping keeps the file open)
+	void const *addr = nullptr;
+	if (file_mapping) {
+		addr = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!addr) {
+		if (file_mapping) CloseHandle(file_mapping);
+		throw std::runtime_error("Failed to map sound bank '" + filename + "'.");
+	}
+	mapping = std::shared_ptr< void const >(addr, [file_mapping](void const *ptr) {
+		UnmapViewOfFile(ptr);
+		CloseHandle(file_mapping);
+	});
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open sound bank '" + filename + "'.");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of sound bank '" + filename + "'.");
+	}
+	mapping_size = size_t(st.st_size);
+	void *addr = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //(the mapping keeps the file alive)
+	if (addr == MAP_FAILED) {
+		throw std::runtime_error("Failed to map sound bank '" + filename + "'.");
+	}
+	size_t unmap_size = mapping_size;
+	mapping = std::shared_ptr< void const >(addr, [unmap_size](void const *ptr) {
+		munmap(const_cast< void * >(ptr), unmap_size);
+	});
+#endif
+
+	//--- parse the chunks ---
+	char const *at = reinterpret_cast< char const * >(mapping.get());
+	char const *end = at + mapping_size;
+
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t data_begin, data_end; //in samples
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+	char const *strings = nullptr;
+	size_t strings_count = 0;
+	view_chunk(&at, end, "str0", &strings, &strings_count);
+
+	IndexEntry const *index = nullptr;
+	size_t index_count = 0;
+	view_chunk(&at, end, "idx0", &index, &index_count);
+
+	//sample data is float, int16, or ADPCM blocks:
+	float const *pcmf = nullptr;
+	int16_t const *pcmi = nullptr;
+	uint8_t const *pcma = nullptr;
+	size_t pcm_count = 0; //in samples
+	std::string pcm_magic = (size_t(end - at) >= 4 ? std::string(at, 4) : "");
+	if (pcm_magic == "pcmi") {
+		view_chunk(&at, end, "pcmi", &pcmi, &pcm_count);
+	} else if (pcm_magic == "pcma") {
+		size_t bytes = 0;
+		view_chunk(&at, end, "pcma", &pcma, &bytes);
+		pcm_count = bytes / ADPCM_BLOCK_BYTES * ADPCM_BLOCK_SAMPLES;
+	} else {
+		view_chunk(&at, end, "pcmf", &pcmf, &pcm_count);
+	}
+
+	if (at != end) {
+		std::cerr << "WARNING: trailing data in sound bank '" << filename << "'." << std::endl;
+	}
+
+	for (size_t i = 0; i < index_count; ++i) {
+		IndexEntry const &entry = index[i];
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings_count)) {
+			throw std::runtime_error("Invalid name range in sound bank '" + filename + "'.");
+		}
+		if (!(entry.data_begin <= entry.data_end && entry.data_end <= pcm_count)) {
+			throw std::runtime_error("Invalid data range in sound bank '" + filename + "'.");
+		}
+		std::string name(strings + entry.name_begin, strings + entry.name_end);
+
+		//samples are played straight out of the mapping, in whatever encoding the bank uses:
+		uint32_t length = entry.data_end - entry.data_begin;
+		bool inserted;
+		if (pcmf) {
+			inserted = samples.emplace(name, Sound::Sample(mapping, pcmf + entry.data_begin, length)).second;
+		} else if (pcmi) {
+			inserted = samples.emplace(name, Sound::Sample(mapping, pcmi + entry.data_begin, length)).second;
+		} else {
+			if (entry.data_begin % ADPCM_BLOCK_SAMPLES != 0) {
+				throw std::runtime_error("Misaligned ADPCM sample in sound bank '" + filename + "'.");
+			}
+			uint8_t const *blocks = pcma + entry.data_begin / ADPCM_BLOCK_SAMPLES * ADPCM_BLOCK_BYTES;
+			inserted = samples.emplace(name, Sound::Sample(mapping, Sound::Sample::ADPCM, blocks, length)).second;
+		}
+		if (!inserted) {
+			std::cerr << "WARNING: sound bank '" << filename << "' has multiple samples named '" << name << "'; only the first will be used." << std::endl;
+		}
+	}
+}
+
+Sound::Sample const &SoundBank::lookup(std::string const &name) const {
+	auto f = samples.find(name);
+	if (f == samples.end()) {
+		throw std::runtime_error("Sample named '" + name + "' not found in sound bank.");
+	}
+	return f->second;
+}
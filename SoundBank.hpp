@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+ * A SoundBank is one file holding many 48kHz mono samples, packed ahead of time
+ *  by the 'build-bank' tool (see Maekfile.js and build-bank.cpp).
+ * The file is memory-mapped, and each entry is exposed as a Sound::Sample that
+ *  views the mapped pages directly -- so loading costs page faults instead of decoding,
+ *  and several copies of the game running at once share the same physical memory.
+ * The samples share ownership of the mapping, so it stays mapped until the bank
+ *  *and* every Sample (or playing sound) that came from it are gone.
+ * Samples can be looked up by name using SoundBank::lookup().
+ *
+ */
+
+#include "Sound.hpp"
+
+#include <map>
+#include <memory>
+#include <string>
+
+struct SoundBank {
+	//map a bank file:
+	// note: will throw if file fails to map or parse.
+	SoundBank(std::string const &filename);
+
+	//look up a particular sample by name:
+	// note: will throw if sample not found.
+	Sound::Sample const &lookup(std::string const &name) const;
+
+	//-- internals ---
+
+	//used by the lookup() function:
+	std::map< std::string, Sound::Sample > samples;
+
+	//the mapped file (unmapped when the last reference goes away):
+	std::shared_ptr< void const > mapping;
+	size_t mapping_size = 0;
+};
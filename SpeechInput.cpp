@@ -0,0 +1,94 @@
+#include "SpeechInput.hpp"
+
+#include "load_opus.hpp"
+#include "load_wav.hpp"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+SpeechInput::SpeechInput() {
+	if (SDL_WasInit(SDL_INIT_AUDIO) == 0 && SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+		throw std::runtime_error("Failed to initialize SDL audio subsystem: " + std::string(SDL_GetError()));
+	}
+
+	SDL_AudioSpec want, have;
+	SDL_zero(want);
+	want.freq = KeywordSpotter::Rate;
+	want.format = AUDIO_F32SYS;
+	want.channels = 1;
+	want.samples = 512;
+	want.callback = capture;
+	want.userdata = this;
+
+	//(no changes allowed -- SDL converts whatever the device records to 48kHz mono float)
+	device = SDL_OpenAudioDevice(nullptr, 1, &want, &have, 0);
+	if (device == 0) {
+		throw std::runtime_error("Failed to open recording device: " + std::string(SDL_GetError()));
+	}
+	std::cout << "Recording device opened for speech input." << std::endl;
+
+	SDL_PauseAudioDevice(device, 0);
+}
+
+SpeechInput::SpeechInput(std::vector< std::string > const &files, float gap) : file_mode(true) {
+	std::vector< float > silence(size_t(std::max(0.0f, gap) * KeywordSpotter::Rate), 0.0f);
+	std::vector< float > data;
+	for (auto const &file : files) {
+		if (file.size() >= 4 && file.substr(file.size()-4) == ".wav") {
+			load_wav(file, &data);
+		} else if (file.size() >= 5 && file.substr(file.size()-5) == ".opus") {
+			load_opus(file, &data);
+		} else {
+			throw std::runtime_error("Speech input '" + file + "' doesn't end in either \".wav\" or \".opus\" -- unsure how to load.");
+		}
+		file_audio.insert(file_audio.end(), silence.begin(), silence.end());
+		file_ranges.emplace_back(file_audio.size(), file_audio.size() + data.size());
+		file_audio.insert(file_audio.end(), data.begin(), data.end());
+	}
+	file_audio.insert(file_audio.end(), silence.begin(), silence.end());
+}
+
+SpeechInput::~SpeechInput() {
+	if (device != 0) {
+		SDL_CloseAudioDevice(device); //(waits for any callback in progress)
+		device = 0;
+	}
+}
+
+void SpeechInput::capture(void *userdata, Uint8 *stream, int len) {
+	SpeechInput &input = *reinterpret_cast< SpeechInput * >(userdata);
+	uint32_t count = uint32_t(len) / sizeof(float);
+	uint32_t pushed = input.captured.push_n(reinterpret_cast< float const * >(stream), count);
+	if (pushed < count) input.dropped.fetch_add(count - pushed, std::memory_order_relaxed);
+}
+
+void SpeechInput::update(float elapsed) {
+	if (file_mode && file_position < file_audio.size()) {
+		//'record' the next 'elapsed' seconds of the files:
+		file_time += double(elapsed);
+		size_t until = std::min(file_audio.size(), size_t(file_time * KeywordSpotter::Rate));
+		while (file_position < until) {
+			uint32_t count = uint32_t(std::min< size_t >(until - file_position, 4096));
+			uint32_t pushed = captured.push_n(file_audio.data() + file_position, count);
+			file_position += pushed;
+			if (pushed < count) {
+				//(the ring is full -- drain it before going on; a real device would have dropped these)
+				drained.resize(captured.size());
+				spotter.feed(drained.data(), captured.pop_n(drained.data(), uint32_t(drained.size())));
+			}
+		}
+	}
+
+	drained.resize(captured.size());
+	uint32_t got = captured.pop_n(drained.data(), uint32_t(drained.size()));
+	if (got) spotter.feed(drained.data(), got);
+
+	//at the end of the files, decide on anything left:
+	if (file_mode && file_position == file_audio.size() && captured.size() == 0) {
+		spotter.flush();
+	}
+}
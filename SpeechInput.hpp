@@ -0,0 +1,65 @@
+#pragma once
+
+/*
+ * SpeechInput feeds a KeywordSpotter from the default recording device, or
+ *  (as a stand-in for one, e.g. for testing) from a list of WAV files.
+ *
+ * The recording device's callback only copies samples into a lock-free ring;
+ *  update() (on the game thread) drains the ring through the spotter, so the
+ *  DSP never runs on SDL's audio thread. If update() falls more than the
+ *  ring's length (about 1.3 seconds) behind, samples are dropped and counted.
+ *
+ * File input goes through exactly the same ring and update() path: each call
+ *  'plays' another 'elapsed' seconds of the files into the ring, as if it had
+ *  just been recorded.
+ */
+
+#include "KeywordSpotter.hpp"
+#include "spsc_ring.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct SpeechInput {
+	//listen to the default recording device (48kHz mono; SDL converts from whatever it has):
+	// note: will throw if there isn't one or it can't be opened.
+	SpeechInput();
+
+	//'play' these files (.wav or .opus) one after another instead, with 'gap' seconds of silence
+	// before each and after the last:
+	// note: will throw if a file can't be loaded.
+	SpeechInput(std::vector< std::string > const &files, float gap = 0.5f);
+
+	~SpeechInput();
+
+	SpeechInput(SpeechInput const &) = delete;
+	SpeechInput &operator=(SpeechInput const &) = delete;
+
+	//run the audio recorded since the last call (or the next 'elapsed' seconds of the files) through 'spotter':
+	// (then call spotter.poll() for any decisions)
+	void update(float elapsed);
+
+	//have the files all been fed through (and the spotter flushed)? (always false for a device)
+	bool done() const { return file_mode && file_position == file_audio.size(); }
+
+	KeywordSpotter spotter;
+
+	//-- internals ---
+
+	uint32_t device = 0; //(SDL_AudioDeviceID)
+	static void capture(void *userdata, uint8_t *stream, int len); //recording device callback
+
+	SPSCRing< float, 65536 > captured;
+	std::atomic< uint64_t > dropped{0}; //samples that didn't fit in 'captured'
+
+	bool file_mode = false;
+	std::vector< float > file_audio; //all the files, with gaps
+	std::vector< std::pair< size_t, size_t > > file_ranges; //where each file is in file_audio (= stream position)
+	size_t file_position = 0; //how much of file_audio has gone into 'captured'
+	double file_time = 0.0; //(seconds of file_audio that should have been 'recorded' so far)
+
+	std::vector< float > drained; //scratch for update()
+};
@@ -0,0 +1,241 @@
+#include "adpcm.hpp"
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ADPCM_X86 1
+#include <immintrin.h>
+#endif
+
+//(see mix_kernels.cpp)
+#if defined(__GNUC__) || defined(__clang__)
+#define ADPCM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define ADPCM_TARGET_AVX2
+#endif
+
+namespace {
+	//the standard IMA ADPCM tables:
+	constexpr int32_t const StepTable[89] = {
+		7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+		19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+		50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+		130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+		337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+		876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+		2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+		5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+		15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+	};
+	constexpr int32_t const IndexTable[16] = {
+		-1, -1, -1, -1, 2, 4, 6, 8,
+		-1, -1, -1, -1, 2, 4, 6, 8
+	};
+
+	struct State {
+		int32_t predictor = 0;
+		int32_t index = 0;
+	};
+
+	//advance 'state' by one 4-bit code (shared by the encoder and decoder, so they stay in step):
+	inline void step(State &state, uint32_t code) {
+		int32_t size = StepTable[state.index];
+		int32_t diff = size >> 3;
+		if (code & 4) diff += size;
+		if (code & 2) diff += size >> 1;
+		if (code & 1) diff += size >> 2;
+		state.predictor += (code & 8 ? -diff : diff);
+		state.predictor = std::max(-32768, std::min(32767, state.predictor));
+		state.index = std::max(0, std::min(88, state.index + IndexTable[code]));
+	}
+
+	//pick the code that moves 'state' closest to 'target':
+	inline uint32_t quantize(State const &state, int32_t target) {
+		int32_t size = StepTable[state.index];
+		int32_t diff = target - state.predictor;
+		uint32_t code = 0;
+		if (diff < 0) {
+			code = 8;
+			diff = -diff;
+		}
+		if (diff >= size) { code |= 4; diff -= size; }
+		if (diff >= (size >> 1)) { code |= 2; diff -= (size >> 1); }
+		if (diff >= (size >> 2)) { code |= 1; }
+		return code;
+	}
+
+	inline int32_t to_int16(float value) {
+		return int32_t(std::max(-32768.0f, std::min(32767.0f, std::round(value * 32768.0f))));
+	}
+
+	//decode a whole block into 'out':
+	void decode_block(uint8_t const *block, float *out) {
+		State state;
+		int16_t predictor;
+		std::memcpy(&predictor, block, sizeof(predictor)); //(block may not be aligned)
+		state.predictor = predictor;
+		state.index = std::min< int32_t >(88, block[2]);
+		int16_t decoded[ADPCM_BLOCK_SAMPLES];
+		uint8_t const *codes = block + 4;
+		for (uint32_t i = 0; i < ADPCM_BLOCK_SAMPLES; i += 2) {
+			uint8_t byte = codes[i / 2];
+			step(state, byte & 0xf);
+			decoded[i] = int16_t(state.predictor);
+			step(state, byte >> 4);
+			decoded[i+1] = int16_t(state.predictor);
+		}
+		convert_int16_to_float(decoded, ADPCM_BLOCK_SAMPLES, out);
+	}
+
+#ifdef ADPCM_X86
+	//Each block is a serial chain of decoding steps, but blocks don't depend on each other,
+	// so the AVX2 decoder runs eight blocks at once, one per lane, doing exactly what step() does:
+	constexpr uint32_t const WideBlocks = 8;
+
+	ADPCM_TARGET_AVX2
+	void decode_blocks_avx2(uint8_t const *blocks, float *out) {
+		__m256i const offset = _mm256_setr_epi32(
+			0 * ADPCM_BLOCK_BYTES, 1 * ADPCM_BLOCK_BYTES, 2 * ADPCM_BLOCK_BYTES, 3 * ADPCM_BLOCK_BYTES,
+			4 * ADPCM_BLOCK_BYTES, 5 * ADPCM_BLOCK_BYTES, 6 * ADPCM_BLOCK_BYTES, 7 * ADPCM_BLOCK_BYTES);
+		int const *base = reinterpret_cast< int const * >(blocks);
+
+		//headers: int16 predictor in the low half, step index in the next byte:
+		__m256i header = _mm256_i32gather_epi32(base, offset, 1);
+		__m256i predictor = _mm256_srai_epi32(_mm256_slli_epi32(header, 16), 16);
+		__m256i index = _mm256_min_epi32(_mm256_and_si256(_mm256_srli_epi32(header, 16), _mm256_set1_epi32(0xff)), _mm256_set1_epi32(88));
+
+		__m256i const low_bits = _mm256_set1_epi32(0xf);
+		__m256i const two = _mm256_set1_epi32(2);
+		__m256i const minus_one = _mm256_set1_epi32(-1);
+		__m256i const zero = _mm256_setzero_si256();
+		__m256i const max_index = _mm256_set1_epi32(88);
+		__m256i const min_value = _mm256_set1_epi32(-32768);
+		__m256i const max_value = _mm256_set1_epi32(32767);
+
+		//decoded values, sample-major (value i of block l is at [i * WideBlocks + l]):
+		int32_t decoded[ADPCM_BLOCK_SAMPLES * WideBlocks];
+		for (uint32_t word = 0; word < ADPCM_BLOCK_SAMPLES / 8; ++word) {
+			//eight codes (four bytes) from each block:
+			__m256i codes = _mm256_i32gather_epi32(base + 1 + word, offset, 1);
+			for (uint32_t c = 0; c < 8; ++c) {
+				__m256i code = _mm256_and_si256(codes, low_bits);
+				codes = _mm256_srli_epi32(codes, 4);
+
+				//bit masks (all ones where the code bit is set):
+				__m256i bit0 = _mm256_srai_epi32(_mm256_slli_epi32(code, 31), 31);
+				__m256i bit1 = _mm256_srai_epi32(_mm256_slli_epi32(code, 30), 31);
+				__m256i bit2 = _mm256_srai_epi32(_mm256_slli_epi32(code, 29), 31);
+				__m256i bit3 = _mm256_srai_epi32(_mm256_slli_epi32(code, 28), 31);
+
+				__m256i size = _mm256_i32gather_epi32(StepTable, index, 4);
+				__m256i diff = _mm256_srai_epi32(size, 3);
+				diff = _mm256_add_epi32(diff, _mm256_and_si256(size, bit2));
+				diff = _mm256_add_epi32(diff, _mm256_and_si256(_mm256_srai_epi32(size, 1), bit1));
+				diff = _mm256_add_epi32(diff, _mm256_and_si256(_mm256_srai_epi32(size, 2), bit0));
+				diff = _mm256_sub_epi32(_mm256_xor_si256(diff, bit3), bit3); //negate if bit 3 is set
+
+				predictor = _mm256_add_epi32(predictor, diff);
+				predictor = _mm256_max_epi32(min_value, _mm256_min_epi32(max_value, predictor));
+
+				//IndexTable[code] is -1 for (code & 7) < 4, otherwise 2 * ((code & 3) + 1):
+				__m256i grow = _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(code, _mm256_set1_epi32(3)), 1), two);
+				__m256i change = _mm256_or_si256(_mm256_and_si256(bit2, grow), _mm256_andnot_si256(bit2, minus_one));
+				index = _mm256_max_epi32(zero, _mm256_min_epi32(max_index, _mm256_add_epi32(index, change)));
+
+				_mm256_storeu_si256(reinterpret_cast< __m256i * >(decoded + (word * 8 + c) * WideBlocks), predictor);
+			}
+		}
+
+		//transpose back to block-major order while converting (same scaling as convert_int16_to_float):
+		for (uint32_t l = 0; l < WideBlocks; ++l) {
+			for (uint32_t i = 0; i < ADPCM_BLOCK_SAMPLES; ++i) {
+				out[l * ADPCM_BLOCK_SAMPLES + i] = float(decoded[i * WideBlocks + l]) * (1.0f / 32768.0f);
+			}
+		}
+	}
+
+	bool use_avx2() {
+		static bool const avx2 = (std::strcmp(mix_kernel_name(), "avx2") == 0);
+		return avx2;
+	}
+#endif
+}
+
+std::vector< uint8_t > adpcm_encode(float const *src, size_t count) {
+	std::vector< uint8_t > blocks(adpcm_bytes(count), 0);
+
+	State state;
+	if (count > 0) state.predictor = to_int16(src[0]);
+
+	for (size_t b = 0; b * ADPCM_BLOCK_SAMPLES < count; ++b) {
+		int32_t target[ADPCM_BLOCK_SAMPLES];
+		for (uint32_t i = 0; i < ADPCM_BLOCK_SAMPLES; ++i) {
+			size_t s = b * ADPCM_BLOCK_SAMPLES + i;
+			target[i] = (s < count ? to_int16(src[s]) : 0);
+		}
+
+		//every block records its starting step index, so try them all and keep whichever tracks best:
+		// (this lets a block start right on a loud attack instead of spending samples adapting)
+		int32_t best_index = state.index;
+		int64_t best_error = INT64_MAX;
+		for (int32_t index = 0; index <= 88; ++index) {
+			State trial = state;
+			trial.index = index;
+			int64_t error = 0;
+			for (uint32_t i = 0; i < ADPCM_BLOCK_SAMPLES && error < best_error; ++i) {
+				step(trial, quantize(trial, target[i]));
+				int64_t d = int64_t(trial.predictor - target[i]);
+				error += d * d;
+			}
+			if (error < best_error) {
+				best_error = error;
+				best_index = index;
+			}
+		}
+		state.index = best_index;
+
+		uint8_t *block = blocks.data() + b * ADPCM_BLOCK_BYTES;
+		int16_t predictor = int16_t(state.predictor);
+		std::memcpy(block, &predictor, sizeof(predictor));
+		block[2] = uint8_t(state.index);
+		block[3] = 0;
+
+		uint8_t *codes = block + 4;
+		for (uint32_t i = 0; i < ADPCM_BLOCK_SAMPLES; ++i) {
+			uint32_t code = quantize(state, target[i]);
+			step(state, code);
+			codes[i / 2] |= uint8_t(code << (4 * (i % 2)));
+		}
+	}
+
+	return blocks;
+}
+
+void adpcm_decode(uint8_t const *blocks, size_t begin, size_t count, float *out) {
+	float decoded[8 * ADPCM_BLOCK_SAMPLES];
+	while (count > 0) {
+		size_t b = begin / ADPCM_BLOCK_SAMPLES;
+		uint32_t offset = uint32_t(begin % ADPCM_BLOCK_SAMPLES);
+		uint32_t n;
+#ifdef ADPCM_X86
+		if (use_avx2() && offset + count >= WideBlocks * ADPCM_BLOCK_SAMPLES) {
+			n = WideBlocks * ADPCM_BLOCK_SAMPLES - offset;
+			decode_blocks_avx2(blocks + b * ADPCM_BLOCK_BYTES, decoded);
+		} else
+#endif
+		{
+			n = uint32_t(std::min< size_t >(count, ADPCM_BLOCK_SAMPLES - offset));
+			decode_block(blocks + b * ADPCM_BLOCK_BYTES, decoded);
+		}
+		std::copy(decoded + offset, decoded + offset + n, out);
+
+		begin += n;
+		count -= n;
+		out += n;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//IMA ADPCM in small, independently-decodable blocks -- one of the encodings Sound::Sample
+// can keep resident (about 7x smaller than float data), decoded by the mixer as it plays.
+//
+//Each block holds ADPCM_BLOCK_SAMPLES samples in ADPCM_BLOCK_BYTES bytes:
+// |int16 predictor|uint8 step index|uint8 (unused)| then one 4-bit code per sample,
+// two per byte (earlier sample in the low nibble).
+//The header is the decoder state before the block's first sample, so decoding can start at
+// any block; the last block of a sample is padded out with silence.
+
+constexpr uint32_t const ADPCM_BLOCK_SAMPLES = 64;
+constexpr uint32_t const ADPCM_BLOCK_BYTES = 4 + ADPCM_BLOCK_SAMPLES / 2;
+
+//number of bytes needed to hold 'count' samples:
+inline size_t adpcm_bytes(size_t count) {
+	return (count + ADPCM_BLOCK_SAMPLES - 1) / ADPCM_BLOCK_SAMPLES * ADPCM_BLOCK_BYTES;
+}
+
+//encode 'count' samples (nominally in [-1,1]; clamped) as ADPCM blocks:
+std::vector< uint8_t > adpcm_encode(float const *src, size_t count);
+
+//decode samples [begin, begin + count) of the data starting at 'blocks' into 'out':
+// (decoding starts at the block holding 'begin', so keep spans long when reading sequentially)
+void adpcm_decode(uint8_t const *blocks, size_t begin, size_t count, float *out);
@@ -0,0 +1,205 @@
+//bench-sound runs the mixer without an audio device and reports how fast it is.
+//
+//Usage:
+//  bench-sound [--voices N] [--seconds S] [--mix 2d|3d|loop|ramp|binaural|all] [--encoding float|int16|adpcm] [--block 128|256|512|1024] [--threads T] [--hrtf FILE] [--effects] [--tap]
+//
+//Plays N synthetic voices (sample content is fixed, so runs are comparable) and renders
+// S seconds of audio through Sound::render_offline (with sample data stored in the given encoding,
+// mixed in blocks of the given size -- see Sound::Latency -- on T threads), then prints:
+//  - ns per output frame (lower is better)
+//  - voices per core at real-time (how many voices like these one core could mix at 48kHz)
+//  - a checksum of the output (changes if the mixer's output changes)
+//
+//The binaural mix plays 3D voices circling the listener through an HRTF (loaded from FILE, or the
+// spherical head model if none is given; see hrtf.hpp). It isn't part of 'all'.
+//
+//With --effects, voices are spread over the music, SFX, and voice buses, each bus gets an EQ and a
+// reverb, and the master bus gets a limiter (see bus_effects.hpp).
+//
+//With --tap, the output tap is on and an AudioScope reads it after every block (outside the timed
+// part), so the timing includes the cost of publishing blocks to the tap.
+
+#include "Sound.hpp"
+#include "hrtf.hpp"
+#include "AudioScope.hpp"
+#include "bus_effects.hpp"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	try {
+		uint32_t voice_count = 32;
+		float seconds = 10.0f;
+		std::string mix = "all";
+		std::string encoding_name = "float";
+		Sound::Latency latency;
+		uint32_t threads = 1;
+		std::string hrtf_file;
+		bool effects = false;
+		bool tap = false;
+		for (int argi = 1; argi < argc; ++argi) {
+			std::string arg = argv[argi];
+			if (arg == "--voices" && argi + 1 < argc) {
+				voice_count = uint32_t(std::stoul(argv[++argi]));
+			} else if (arg == "--seconds" && argi + 1 < argc) {
+				seconds = std::stof(argv[++argi]);
+			} else if (arg == "--mix" && argi + 1 < argc) {
+				mix = argv[++argi];
+			} else if (arg == "--encoding" && argi + 1 < argc) {
+				encoding_name = argv[++argi];
+			} else if (arg == "--block" && argi + 1 < argc) {
+				latency.frames = uint32_t(std::stoul(argv[++argi]));
+			} else if (arg == "--threads" && argi + 1 < argc) {
+				threads = uint32_t(std::stoul(argv[++argi]));
+			} else if (arg == "--hrtf" && argi + 1 < argc) {
+				hrtf_file = argv[++argi];
+			} else if (arg == "--effects") {
+				effects = true;
+			} else if (arg == "--tap") {
+				tap = true;
+			} else {
+				std::cerr << "Usage:\n\t" << argv[0] << " [--voices N] [--seconds S] [--mix 2d|3d|loop|ramp|binaural|all] [--encoding float|int16|adpcm] [--block 128|256|512|1024] [--threads T] [--hrtf FILE] [--effects] [--tap]" << std::endl;
+				return 1;
+			}
+		}
+		if (!(mix == "2d" || mix == "3d" || mix == "loop" || mix == "ramp" || mix == "binaural" || mix == "all")) {
+			throw std::runtime_error("Unknown mix '" + mix + "'; expecting 2d, 3d, loop, ramp, binaural, or all.");
+		}
+		Sound::Sample::Encoding encoding;
+		if (encoding_name == "float") encoding = Sound::Sample::Float;
+		else if (encoding_name == "int16") encoding = Sound::Sample::Int16;
+		else if (encoding_name == "adpcm") encoding = Sound::Sample::ADPCM;
+		else throw std::runtime_error("Unknown encoding '" + encoding_name + "'; expecting float, int16, or adpcm.");
+		if (voice_count == 0 || !(seconds > 0.0f)) {
+			throw std::runtime_error("Need at least one voice and some time to render.");
+		}
+
+		constexpr uint32_t const Rate = 48000;
+		constexpr uint32_t const Block = 256; //frames rendered between game-side updates (a little over 5ms)
+
+		Sound::init(voice_count, false, latency);
+		Sound::set_mix_threads(threads);
+		if (mix == "binaural") {
+			Sound::set_hrtf(std::make_shared< HRTF const >(hrtf_file.empty() ? HRTF::spherical_head() : HRTF(hrtf_file)));
+		}
+		if (effects) {
+			for (Sound::Bus bus : {Sound::MusicBus, Sound::SFXBus, Sound::VoiceBus}) {
+				Sound::add_effect(bus, std::make_shared< Biquad >(Biquad::HighShelf, 4000.0f, 0.7071f, -3.0f));
+				Sound::add_effect(bus, std::make_shared< Reverb >(1.2f, 0.3f, 0.15f));
+			}
+			Sound::add_effect(Sound::MasterBus, std::make_shared< Limiter >());
+		}
+		AudioScope scope;
+		if (tap) Sound::set_tap(true);
+
+		//a few deterministic test signals of different lengths (so voices end and loop at different times):
+		std::vector< Sound::Sample > samples;
+		for (uint32_t s = 0; s < 4; ++s) {
+			std::vector< float > data((s + 1) * Rate / 2);
+			uint32_t noise = 0x12345678 + s;
+			for (uint32_t i = 0; i < data.size(); ++i) {
+				noise = noise * 1664525U + 1013904223U;
+				float n = float(noise >> 8) / float(1 << 24) - 0.5f;
+				data[i] = 0.4f * std::sin(float(i) * (0.01f + 0.005f * s)) + 0.1f * n;
+			}
+			samples.emplace_back(data, encoding);
+		}
+
+		//binaural voices circle the listener at different speeds (and bob up and down):
+		auto orbit = [](uint32_t v, float t) -> glm::vec3 {
+			float a = t * (0.5f + 0.25f * float(v % 5)) + float(v);
+			return glm::vec3(2.0f * std::cos(a), 2.0f * std::sin(a), 0.5f * std::sin(0.7f * a));
+		};
+
+		//start (or restart) voice 'v' according to the chosen mix:
+		auto start = [&](uint32_t v) -> Sound::PlayingSample {
+			Sound::Sample const &sample = samples[v % samples.size()];
+			std::string kind = mix;
+			if (kind == "all") {
+				char const *kinds[] = {"2d", "3d", "loop", "ramp"};
+				kind = kinds[v % 4];
+			}
+			float pan = -1.0f + 2.0f * float(v % 7) / 6.0f;
+			Sound::Bus bus = (effects ? Sound::MusicBus + v % 3 : Sound::MasterBus);
+			if (kind == "2d") {
+				return Sound::play(sample, 0.5f, pan, bus);
+			} else if (kind == "3d") {
+				return Sound::play_3D(sample, 0.5f, glm::vec3(float(v % 5) - 2.0f, float(v % 3), 0.0f), 2.0f, bus);
+			} else if (kind == "binaural") {
+				return Sound::play_3D(sample, 0.5f, orbit(v, 0.0f), 2.0f, bus);
+			} else { //loop and ramp voices both loop; ramp voices also get moved around every block:
+				return Sound::loop(sample, 0.5f, pan, bus);
+			}
+		};
+		bool ramping = (mix == "ramp" || mix == "all");
+
+		std::vector< Sound::PlayingSample > playing(voice_count);
+		for (uint32_t v = 0; v < voice_count; ++v) {
+			playing[v] = start(v);
+		}
+
+		uint32_t total_frames = uint32_t(seconds * Rate);
+		std::vector< float > out(2 * Block);
+
+		uint64_t checksum = 14695981039346656037ULL; //FNV-1a over the output bytes
+		double mix_seconds = 0.0;
+		uint32_t block_index = 0;
+		for (uint32_t done = 0; done < total_frames; done += Block, ++block_index) {
+			//game-side updates: restart finished voices, ramp parameters, move the listener:
+			for (uint32_t v = 0; v < voice_count; ++v) {
+				if (playing[v].stopped()) playing[v] = start(v);
+				if (ramping && v % 4 == 3) {
+					float t = float(block_index) * 0.05f + float(v);
+					playing[v].set_volume(0.25f + 0.25f * std::sin(t), float(Block) / Rate);
+					playing[v].set_pan(std::cos(t), float(Block) / Rate);
+				}
+				if (mix == "binaural") {
+					playing[v].set_position(orbit(v, float(done + Block) / Rate), float(Block) / Rate);
+				}
+			}
+			if (ramping) {
+				float t = float(block_index) * 0.01f;
+				Sound::listener.set_position_right(glm::vec3(std::sin(t), 0.0f, 0.0f), glm::vec3(std::cos(t), std::sin(t), 0.0f), float(Block) / Rate);
+			}
+
+			auto before = std::chrono::high_resolution_clock::now();
+			Sound::render_offline(Block, out.data());
+			auto after = std::chrono::high_resolution_clock::now();
+			mix_seconds += std::chrono::duration< double >(after - before).count();
+			if (tap) scope.update(float(Block) / Rate);
+
+			unsigned char const *bytes = reinterpret_cast< unsigned char const * >(out.data());
+			for (size_t b = 0; b < out.size() * sizeof(float); ++b) {
+				checksum = (checksum ^ bytes[b]) * 1099511628211ULL;
+			}
+		}
+
+		Sound::shutdown();
+
+		uint32_t rendered = ((total_frames + Block - 1) / Block) * Block;
+		double ns_per_frame = mix_seconds * 1.0e9 / double(rendered);
+		double realtime_ns_per_frame = 1.0e9 / double(Rate);
+
+		std::cout << "mix: " << mix << ", " << encoding_name << " samples, " << latency.frames << "-frame blocks, " << threads << " thread(s), " << (effects ? "bus effects, " : "") << (tap ? "tap, " : "") << voice_count << " voices, " << rendered << " frames ("
+		          << std::fixed << std::setprecision(2) << double(rendered) / Rate << " s of audio)" << std::endl;
+		std::cout << "  " << ns_per_frame << " ns per output frame" << std::endl;
+		std::cout << "  " << std::setprecision(0) << voice_count * realtime_ns_per_frame / ns_per_frame << " voices per core at real-time" << std::endl;
+		if (tap) std::cout << "  " << Sound::stats().tap_dropped << " blocks dropped from tap" << std::endl;
+		std::cout << "  checksum " << std::hex << std::setw(16) << std::setfill('0') << checksum << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "bench-sound failed:\n" << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
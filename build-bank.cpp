@@ -0,0 +1,124 @@
+//build-bank packs a collection of sound files into a single SoundBank file.
+//
+//Usage:
+//  build-bank [--int16|--adpcm] <out.bank> <in1.opus|wav> [in2.opus|wav] [...]
+//
+//Each input is decoded (as Sound::Sample would decode it) to 48kHz mono, and stored
+// under its file name without directory or extension (e.g., "dist/sounds/a.opus" -> "a").
+//
+//Output format (see read_write_chunk.hpp):
+// |str0| names, concatenated, padded with zeros to a multiple of four bytes
+// |idx0| one IndexEntry per sample
+// |pcmf| (default) float samples   -or-   |pcmi| (--int16) int16 samples
+//   -or-   |pcma| (--adpcm) ADPCM blocks (see adpcm.hpp); each sample starts on a block boundary
+
+#include "adpcm.hpp"
+#include "load_opus.hpp"
+#include "load_wav.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	try {
+		enum { Float, Int16, ADPCM } encoding = Float;
+		std::string out_file;
+		std::vector< std::string > in_files;
+		for (int argi = 1; argi < argc; ++argi) {
+			std::string arg = argv[argi];
+			if (arg == "--int16") {
+				encoding = Int16;
+			} else if (arg == "--adpcm") {
+				encoding = ADPCM;
+			} else if (out_file.empty()) {
+				out_file = arg;
+			} else {
+				in_files.emplace_back(arg);
+			}
+		}
+		if (out_file.empty() || in_files.empty()) {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--int16|--adpcm] <out.bank> <in1.opus|wav> [in2.opus|wav] [...]" << std::endl;
+			return 1;
+		}
+
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t data_begin, data_end; //in samples
+		};
+		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+		std::vector< char > strings;
+		std::vector< IndexEntry > index;
+		std::vector< float > pcm;
+		std::set< std::string > names;
+
+		for (auto const &in_file : in_files) {
+			//name is file name without directory or extension:
+			std::string name = in_file.substr(in_file.find_last_of("/\\") + 1);
+			name = name.substr(0, name.rfind('.'));
+			if (!names.insert(name).second) {
+				throw std::runtime_error("Two inputs are named '" + name + "'.");
+			}
+
+			std::vector< float > data;
+			if (in_file.size() >= 4 && in_file.substr(in_file.size()-4) == ".wav") {
+				load_wav(in_file, &data);
+			} else if (in_file.size() >= 5 && in_file.substr(in_file.size()-5) == ".opus") {
+				load_opus(in_file, &data);
+			} else {
+				throw std::runtime_error("Input '" + in_file + "' doesn't end in either \".wav\" or \".opus\" -- unsure how to load.");
+			}
+
+			IndexEntry entry;
+			entry.name_begin = uint32_t(strings.size());
+			strings.insert(strings.end(), name.begin(), name.end());
+			entry.name_end = uint32_t(strings.size());
+			if (encoding == ADPCM) {
+				//(ADPCM samples must start at a block so they can be decoded on their own)
+				pcm.resize((pcm.size() + ADPCM_BLOCK_SAMPLES - 1) / ADPCM_BLOCK_SAMPLES * ADPCM_BLOCK_SAMPLES, 0.0f);
+			}
+			entry.data_begin = uint32_t(pcm.size());
+			pcm.insert(pcm.end(), data.begin(), data.end());
+			entry.data_end = uint32_t(pcm.size());
+			index.emplace_back(entry);
+		}
+
+		//pad the strings so that the sample data that follows stays aligned:
+		while (strings.size() % 4 != 0) strings.emplace_back('\0');
+
+		std::ofstream out(out_file, std::ios::binary);
+		write_chunk("str0", strings, &out);
+		write_chunk("idx0", index, &out);
+		if (encoding == Int16) {
+			//(same scaling as Sound::Sample uses for int16 data)
+			std::vector< int16_t > pcmi;
+			pcmi.reserve(pcm.size());
+			for (float f : pcm) {
+				pcmi.emplace_back(int16_t(std::max(-32768.0f, std::min(32767.0f, std::round(f * 32768.0f)))));
+			}
+			write_chunk("pcmi", pcmi, &out);
+		} else if (encoding == ADPCM) {
+			write_chunk("pcma", adpcm_encode(pcm.data(), pcm.size()), &out);
+		} else {
+			write_chunk("pcmf", pcm, &out);
+		}
+		if (!out) {
+			throw std::runtime_error("Failed to write '" + out_file + "'.");
+		}
+
+		std::cout << "Wrote " << index.size() << " samples (" << pcm.size() << " frames, "
+		          << (encoding == Int16 ? "int16" : encoding == ADPCM ? "adpcm" : "float") << ") to '" << out_file << "'." << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "build-bank failed:\n" << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,189 @@
+#include "bus_effects.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+	constexpr float const Rate = 48000.0f;
+	constexpr float const Pi = 3.14159265358979323846f;
+}
+
+//------ Biquad ------
+
+Biquad::Biquad(Type type, float frequency, float q, float gain_db) {
+	set(type, frequency, q, gain_db);
+}
+
+void Biquad::set(Type type, float frequency, float q, float gain_db) {
+	float w0 = 2.0f * Pi * std::max(1.0f, std::min(0.49f * Rate, frequency)) / Rate;
+	float cos_w0 = std::cos(w0);
+	float alpha = std::sin(w0) / (2.0f * std::max(1e-3f, q));
+	float A = std::pow(10.0f, gain_db / 40.0f);
+	float root_A_alpha = 2.0f * std::sqrt(A) * alpha;
+
+	float a0 = 1.0f;
+	if (type == LowPass) {
+		b0 = 0.5f * (1.0f - cos_w0); b1 = 1.0f - cos_w0; b2 = 0.5f * (1.0f - cos_w0);
+		a0 = 1.0f + alpha; a1 = -2.0f * cos_w0; a2 = 1.0f - alpha;
+	} else if (type == HighPass) {
+		b0 = 0.5f * (1.0f + cos_w0); b1 = -(1.0f + cos_w0); b2 = 0.5f * (1.0f + cos_w0);
+		a0 = 1.0f + alpha; a1 = -2.0f * cos_w0; a2 = 1.0f - alpha;
+	} else if (type == Peak) {
+		b0 = 1.0f + alpha * A; b1 = -2.0f * cos_w0; b2 = 1.0f - alpha * A;
+		a0 = 1.0f + alpha / A; a1 = -2.0f * cos_w0; a2 = 1.0f - alpha / A;
+	} else if (type == LowShelf) {
+		b0 = A * ((A + 1.0f) - (A - 1.0f) * cos_w0 + root_A_alpha);
+		b1 = 2.0f * A * ((A - 1.0f) - (A + 1.0f) * cos_w0);
+		b2 = A * ((A + 1.0f) - (A - 1.0f) * cos_w0 - root_A_alpha);
+		a0 = (A + 1.0f) + (A - 1.0f) * cos_w0 + root_A_alpha;
+		a1 = -2.0f * ((A - 1.0f) + (A + 1.0f) * cos_w0);
+		a2 = (A + 1.0f) + (A - 1.0f) * cos_w0 - root_A_alpha;
+	} else {
+		assert(type == HighShelf);
+		b0 = A * ((A + 1.0f) + (A - 1.0f) * cos_w0 + root_A_alpha);
+		b1 = -2.0f * A * ((A - 1.0f) + (A + 1.0f) * cos_w0);
+		b2 = A * ((A + 1.0f) + (A - 1.0f) * cos_w0 - root_A_alpha);
+		a0 = (A + 1.0f) - (A - 1.0f) * cos_w0 + root_A_alpha;
+		a1 = 2.0f * ((A - 1.0f) - (A + 1.0f) * cos_w0);
+		a2 = (A + 1.0f) - (A - 1.0f) * cos_w0 - root_A_alpha;
+	}
+	b0 /= a0; b1 /= a0; b2 /= a0;
+	a1 /= a0; a2 /= a0;
+}
+
+void Biquad::process(float *block, uint32_t frames) {
+	for (uint32_t c = 0; c < 2; ++c) {
+		float s1 = z1[c], s2 = z2[c];
+		for (uint32_t i = 0; i < frames; ++i) {
+			float x = block[2*i+c];
+			float y = b0 * x + s1;
+			s1 = b1 * x - a1 * y + s2;
+			s2 = b2 * x - a2 * y;
+			block[2*i+c] = y;
+		}
+		//(flush the state to zero once it has died away, so silence doesn't run on denormals)
+		z1[c] = (std::abs(s1) < 1e-20f ? 0.0f : s1);
+		z2[c] = (std::abs(s2) < 1e-20f ? 0.0f : s2);
+	}
+}
+
+//------ Reverb ------
+
+Reverb::Reverb(float decay, float damping_, float mix_) {
+	//mutually prime lengths between about 30 and 60ms, so echoes don't pile up on the same frames:
+	constexpr uint32_t const Lengths[Lines] = {1433, 1601, 1867, 2053, 2251, 2399, 2617, 2797};
+	for (uint32_t l = 0; l < Lines; ++l) {
+		lines[l].delay.assign(Lengths[l], 0.0f);
+	}
+	set(decay, damping_, mix_);
+}
+
+void Reverb::set(float decay, float damping_, float mix_) {
+	decay = std::max(0.01f, decay);
+	for (auto &line : lines) {
+		//-60dB (a factor of 10^-3) after 'decay' seconds, i.e., after decay * Rate / length trips around the line:
+		line.gain = std::pow(10.0f, -3.0f * float(line.delay.size()) / (decay * Rate));
+	}
+	damping = std::max(0.0f, std::min(0.99f, damping_));
+	mix = std::max(0.0f, std::min(1.0f, mix_));
+}
+
+void Reverb::process(float *block, uint32_t frames) {
+	float const dry = 1.0f - mix;
+	float const wet = mix * 0.5f; //(four lines feed each side)
+	for (uint32_t i = 0; i < frames; ++i) {
+		float in = 0.5f * (block[2*i+0] + block[2*i+1]);
+
+		//read the lines, damp them, and take the output from alternate lines on each side:
+		float v[Lines];
+		float out_l = 0.0f, out_r = 0.0f;
+		for (uint32_t l = 0; l < Lines; ++l) {
+			Line &line = lines[l];
+			float y = line.delay[line.at];
+			line.lowpass = y + damping * (line.lowpass - y);
+			if (std::abs(line.lowpass) < 1e-20f) line.lowpass = 0.0f;
+			v[l] = line.lowpass * line.gain;
+			if (l % 2 == 0) out_l += y;
+			else out_r += y;
+		}
+
+		//mix the lines through an (orthogonal, so lossless) 8x8 Hadamard matrix -- a fast Walsh-Hadamard transform:
+		for (uint32_t half = 1; half < Lines; half *= 2) {
+			for (uint32_t start = 0; start < Lines; start += 2 * half) {
+				for (uint32_t k = start; k < start + half; ++k) {
+					float a = v[k], b = v[k + half];
+					v[k] = a + b;
+					v[k + half] = a - b;
+				}
+			}
+		}
+		float const norm = 0.35355339f; //1 / sqrt(8)
+
+		//feed back, with the input added to every line:
+		for (uint32_t l = 0; l < Lines; ++l) {
+			Line &line = lines[l];
+			line.delay[line.at] = in + v[l] * norm;
+			line.at += 1;
+			if (line.at == line.delay.size()) line.at = 0;
+		}
+
+		block[2*i+0] = dry * block[2*i+0] + wet * out_l;
+		block[2*i+1] = dry * block[2*i+1] + wet * out_r;
+	}
+}
+
+//------ Limiter ------
+
+Limiter::Limiter(float threshold_, float lookahead_, float release) : threshold(threshold_) {
+	assert(threshold > 0.0f);
+	lookahead = std::max(1U, uint32_t(std::round(lookahead_ * Rate)));
+	release_coef = 1.0f - std::exp(-1.0f / (std::max(1e-4f, release) * Rate));
+	delayed.assign(2 * lookahead, 0.0f);
+	window_gain.assign(lookahead + 1, 1.0f);
+	window_frame.assign(lookahead + 1, 0);
+	envelope_history.assign(lookahead, 1.0f);
+	envelope_sum = double(lookahead);
+}
+
+void Limiter::process(float *block, uint32_t frames) {
+	//How this works: the gain needed for each frame ('target') is held at its minimum over the
+	// lookahead window, released upward gradually, and then averaged over the lookahead window.
+	// The audio is delayed by the lookahead, so every frame averaged into the gain for a peak was
+	// held at or below that peak's target -- the gain ramps down smoothly and arrives in time.
+	uint32_t const capacity = lookahead + 1;
+	for (uint32_t i = 0; i < frames; ++i, ++frame) {
+		float l = block[2*i+0], r = block[2*i+1];
+		float peak = std::max(std::abs(l), std::abs(r));
+		float target = (peak > threshold ? threshold / peak : 1.0f);
+
+		//sliding-window minimum over the last lookahead + 1 targets:
+		while (window_count > 0 && window_frame[window_begin] + lookahead < frame) {
+			window_begin = (window_begin + 1) % capacity;
+			--window_count;
+		}
+		while (window_count > 0 && window_gain[(window_begin + window_count - 1) % capacity] >= target) {
+			--window_count;
+		}
+		window_gain[(window_begin + window_count) % capacity] = target;
+		window_frame[(window_begin + window_count) % capacity] = frame;
+		++window_count;
+		float held = window_gain[window_begin];
+
+		//drop right away, recover slowly:
+		if (held < envelope) envelope = held;
+		else envelope += (held - envelope) * release_coef;
+
+		uint32_t slot = uint32_t(frame % lookahead);
+		envelope_sum += double(envelope) - double(envelope_history[slot]);
+		envelope_history[slot] = envelope;
+		smoothed = std::min(1.0f, float(envelope_sum / double(lookahead)));
+
+		//swap this frame into the delay line for the one from 'lookahead' frames ago:
+		float out_l = delayed[2*slot+0], out_r = delayed[2*slot+1];
+		delayed[2*slot+0] = l;
+		delayed[2*slot+1] = r;
+		block[2*i+0] = out_l * smoothed;
+		block[2*i+1] = out_r * smoothed;
+	}
+}
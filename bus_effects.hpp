@@ -0,0 +1,95 @@
+#pragma once
+
+/*
+ * Effects that run over whole blocks of a Sound bus (see Sound::add_effect).
+ *
+ * Each effect processes interleaved stereo (LRLR...) blocks at 48kHz in place,
+ *  on the audio thread -- so process() must not allocate, lock, or block. Effects
+ *  allocate whatever state they need (e.g., delay lines) when constructed.
+ *
+ * To change an effect's settings once it has been added to a bus, do so between
+ *  Sound::lock() and Sound::unlock(), so the change lands between blocks.
+ */
+
+#include <cstdint>
+#include <vector>
+
+struct Effect {
+	virtual ~Effect() { }
+	//process 'frames' interleaved stereo frames of 'block' in place:
+	virtual void process(float *block, uint32_t frames) = 0;
+};
+
+//Biquad EQ filter (RBJ "Audio EQ Cookbook" designs), run on both channels:
+struct Biquad : Effect {
+	enum Type : uint32_t {
+		LowPass,
+		HighPass,
+		Peak, //boost or cut 'gain_db' around 'frequency'
+		LowShelf, //boost or cut 'gain_db' below 'frequency'
+		HighShelf, //boost or cut 'gain_db' above 'frequency'
+	};
+	Biquad(Type type, float frequency, float q = 0.7071f, float gain_db = 0.0f);
+
+	//change the design (filter state is kept, so this is fine to do while playing):
+	void set(Type type, float frequency, float q = 0.7071f, float gain_db = 0.0f);
+
+	void process(float *block, uint32_t frames) override;
+
+	//coefficients (normalized so a0 == 1) and per-channel state (transposed direct form II):
+	float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+	float z1[2] = {0.0f, 0.0f};
+	float z2[2] = {0.0f, 0.0f};
+};
+
+//Feedback delay network reverb: eight delay lines of mutually prime lengths, mixed through a
+// Hadamard matrix and fed back with per-line gains set so the tail falls by 60dB over 'decay' seconds.
+// 'damping' (0 to 1) darkens the tail over time; 'mix' is the wet fraction of the output.
+struct Reverb : Effect {
+	Reverb(float decay = 1.5f, float damping = 0.3f, float mix = 0.2f);
+
+	//change the settings (the tail already in the delay lines is kept):
+	void set(float decay, float damping, float mix);
+
+	void process(float *block, uint32_t frames) override;
+
+	static constexpr uint32_t const Lines = 8;
+	struct Line {
+		std::vector< float > delay; //(length is the delay, in frames)
+		uint32_t at = 0; //next position to read (and then write)
+		float gain = 0.0f; //feedback gain
+		float lowpass = 0.0f; //damping filter state
+	};
+	Line lines[Lines];
+	float damping = 0.3f;
+	float mix = 0.2f;
+};
+
+//Lookahead peak limiter: delays the signal by 'lookahead' seconds so gain reduction can be ramped in
+// before a peak arrives; peaks never go above 'threshold' (linear, e.g. 0.9 ~= -1dBFS).
+// Gain recovers with time constant 'release' seconds once peaks pass.
+struct Limiter : Effect {
+	Limiter(float threshold = 0.9f, float lookahead = 0.0015f, float release = 0.1f);
+
+	void process(float *block, uint32_t frames) override;
+
+	//gain reduction right now (1.0 = none), e.g. for a meter:
+	float gain() const { return smoothed; }
+
+	float threshold;
+	float release_coef; //per-frame approach of 'envelope' to a higher target
+	uint32_t lookahead; //in frames
+
+	//delayed audio (lookahead + 1 frames, stereo):
+	std::vector< float > delayed;
+	//sliding-window minimum of target gains over the lookahead window (a monotonic queue in a ring):
+	std::vector< float > window_gain;
+	std::vector< uint64_t > window_frame;
+	uint32_t window_begin = 0, window_count = 0;
+	//moving average (over the lookahead) of the envelope, which ramps reduction in ahead of a peak:
+	std::vector< float > envelope_history;
+	double envelope_sum = 0.0;
+	float envelope = 1.0f;
+	float smoothed = 1.0f;
+	uint64_t frame = 0;
+};
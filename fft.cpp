@@ -0,0 +1,131 @@
+#include "fft.hpp"
+
+#include "mix_kernels.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+RealFFT::RealFFT(uint32_t size) : N(size) {
+	if (N < 4 || (N & (N - 1)) != 0) {
+		throw std::invalid_argument("RealFFT size (" + std::to_string(N) + ") should be a power of two, at least 4.");
+	}
+	constexpr double Pi = 3.14159265358979323846;
+	uint32_t const M = N / 2;
+
+	uint32_t bits = 0;
+	while ((1U << bits) < M) ++bits;
+	bit_reverse.resize(M);
+	for (uint32_t i = 0; i < M; ++i) {
+		uint32_t r = 0;
+		for (uint32_t b = 0; b < bits; ++b) {
+			if (i & (1U << b)) r |= 1U << (bits - 1 - b);
+		}
+		bit_reverse[i] = r;
+	}
+
+	//(computed in double so the tables are as accurate as floats allow)
+	//each stage's twiddles are stored contiguously (stage with butterflies 'half' apart starts at half - 1),
+	// so the butterfly loop reads them in order:
+	twiddle_re.resize(M - 1);
+	twiddle_im.resize(M - 1);
+	for (uint32_t half = 1; half < M; half *= 2) {
+		for (uint32_t k = 0; k < half; ++k) {
+			twiddle_re[half - 1 + k] = float(std::cos(-Pi * k / half));
+			twiddle_im[half - 1 + k] = float(std::sin(-Pi * k / half));
+		}
+	}
+	untangle_re.resize(M / 2 + 1);
+	untangle_im.resize(M / 2 + 1);
+	for (uint32_t k = 0; k <= M / 2; ++k) {
+		untangle_re[k] = float(std::cos(-2.0 * Pi * k / N));
+		untangle_im[k] = float(std::sin(-2.0 * Pi * k / N));
+	}
+}
+
+void RealFFT::complex_transform(float *re, float *im, bool inverse) const {
+	uint32_t const M = N / 2;
+	for (uint32_t i = 0; i < M; ++i) {
+		uint32_t j = bit_reverse[i];
+		if (i < j) {
+			std::swap(re[i], re[j]);
+			std::swap(im[i], im[j]);
+		}
+	}
+	//radix-2 butterflies; the inverse transform uses conjugate twiddles:
+	float const sign = (inverse ? -1.0f : 1.0f);
+	for (uint32_t half = 1; half < M; half *= 2) {
+		float const *stage_re = twiddle_re.data() + (half - 1);
+		float const *stage_im = twiddle_im.data() + (half - 1);
+		for (uint32_t start = 0; start < M; start += 2 * half) {
+			float *a_re = re + start, *a_im = im + start;
+			float *b_re = a_re + half, *b_im = a_im + half;
+			if (half >= 4) {
+				//(wide enough groups go to the vector kernel)
+				fft_butterflies(a_re, a_im, b_re, b_im, stage_re, stage_im, sign, half);
+			} else {
+				fft_butterflies_scalar(a_re, a_im, b_re, b_im, stage_re, stage_im, sign, half);
+			}
+		}
+	}
+}
+
+void RealFFT::forward(float const *in, float *re, float *im) const {
+	uint32_t const M = N / 2;
+	//pack even samples as real parts, odd samples as imaginary parts:
+	for (uint32_t n = 0; n < M; ++n) {
+		re[n] = in[2*n+0];
+		im[n] = in[2*n+1];
+	}
+	complex_transform(re, im, false);
+
+	//untangle Z = E + iO (spectra of even and odd samples) into X[k] = E[k] + W^k O[k];
+	// bins k and M-k depend on each other, so they are done in pairs:
+	float z0r = re[0], z0i = im[0];
+	re[0] = z0r + z0i; im[0] = 0.0f;
+	re[M] = z0r - z0i; im[M] = 0.0f;
+	for (uint32_t k = 1; k <= M / 2; ++k) {
+		uint32_t j = M - k;
+		float zkr = re[k], zki = im[k];
+		float zjr = re[j], zji = im[j];
+		//E[k] = (Z[k] + conj(Z[j])) / 2, O[k] = (Z[k] - conj(Z[j])) / 2i:
+		float er = 0.5f * (zkr + zjr), ei = 0.5f * (zki - zji);
+		float or_ = 0.5f * (zki + zji), oi = -0.5f * (zkr - zjr);
+		//W^k O[k]:
+		float wr = untangle_re[k], wi = untangle_im[k];
+		float tr = or_ * wr - oi * wi;
+		float ti = or_ * wi + oi * wr;
+		re[k] = er + tr; im[k] = ei + ti;
+		//X[j] = conj(E[k]) - conj(W^k O[k]) (E, O are spectra of real signals, and W^j = -conj(W^k)):
+		re[j] = er - tr; im[j] = -(ei - ti);
+	}
+}
+
+void RealFFT::inverse(float *re, float *im, float *out) const {
+	uint32_t const M = N / 2;
+	//retangle X back into Z = E + iO, where E[k] = (X[k] + conj(X[j])) / 2 and O[k] = conj(W^k) (X[k] - conj(X[j])) / 2:
+	float x0 = re[0], xm = re[M];
+	re[0] = 0.5f * (x0 + xm);
+	im[0] = 0.5f * (x0 - xm);
+	for (uint32_t k = 1; k <= M / 2; ++k) {
+		uint32_t j = M - k;
+		float xkr = re[k], xki = im[k];
+		float xjr = re[j], xji = im[j];
+		float er = 0.5f * (xkr + xjr), ei = 0.5f * (xki - xji);
+		float dr = 0.5f * (xkr - xjr), di = 0.5f * (xki + xji);
+		float wr = untangle_re[k], wi = -untangle_im[k];
+		float or_ = dr * wr - di * wi;
+		float oi = dr * wi + di * wr;
+		//Z[k] = E[k] + i O[k]; Z[j] = conj(E[k]) + i conj(O[k]):
+		re[k] = er - oi; im[k] = ei + or_;
+		re[j] = er + oi; im[j] = -ei + or_;
+	}
+	complex_transform(re, im, true);
+
+	float const scale = 1.0f / float(M);
+	for (uint32_t n = 0; n < M; ++n) {
+		out[2*n+0] = re[n] * scale;
+		out[2*n+1] = im[n] * scale;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//Fast Fourier transform of real signals, as used by the HRTF convolver (see hrtf.hpp), AudioScope, and KeywordSpotter.
+//  A size-N real transform is done as a size-N/2 complex radix-2 transform plus an untangling pass.
+//  Spectra are kept as separate real and imaginary arrays (N/2+1 bins each), which is the
+//  layout complex_multiply_add (mix_kernels.hpp) wants.
+//  Twiddle and bit-reversal tables are built by the constructor; the transforms themselves
+//  never allocate, so they are safe to call from the audio callback (from any number of threads).
+
+struct RealFFT {
+	//'size' must be a power of two, at least 4:
+	// note: will throw if it isn't.
+	RealFFT(uint32_t size);
+
+	uint32_t size() const { return N; }
+	uint32_t bins() const { return N / 2 + 1; }
+
+	//transform N real samples from 'in' into bins() complex values in 're' and 'im':
+	void forward(float const *in, float *re, float *im) const;
+
+	//transform bins() complex values back into N real samples in 'out'.
+	// scaled by 1/N, so inverse(forward(x)) == x.
+	// note: 're' and 'im' are used as scratch space (their contents are lost).
+	void inverse(float *re, float *im, float *out) const;
+
+	//-- internals ---
+
+	//in-place complex transform of the first N/2 values of 're' and 'im':
+	void complex_transform(float *re, float *im, bool inverse) const;
+
+	uint32_t N;
+	std::vector< uint32_t > bit_reverse; //N/2 entries
+	std::vector< float > twiddle_re, twiddle_im; //per stage: e^(-pi i k / half), k < half, at [half - 1 + k]
+	std::vector< float > untangle_re, untangle_im; //e^(-2 pi i k / N), k <= N/4
+};
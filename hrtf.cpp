@@ -0,0 +1,281 @@
+#include "hrtf.hpp"
+
+#include "mix_kernels.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+HRTF::HRTF(std::string const &filename) {
+	std::ifstream file(filename, std::ios::binary);
+
+	struct Header {
+		uint32_t rate;
+		uint32_t length;
+	};
+	static_assert(sizeof(Header) == 8, "Header is packed.");
+	std::vector< Header > header;
+	read_chunk(file, "hrh0", &header);
+	if (header.size() != 1) {
+		throw std::runtime_error("HRTF file '" + filename + "' should have exactly one header.");
+	}
+	if (header[0].rate != 48000) {
+		throw std::runtime_error("HRTF file '" + filename + "' is at " + std::to_string(header[0].rate) + " Hz, but only 48000 Hz is supported.");
+	}
+	length = header[0].length;
+
+	static_assert(sizeof(glm::vec3) == 3*4, "vec3 is packed.");
+	read_chunk(file, "hrd0", &directions);
+
+	std::vector< float > hrirs;
+	read_chunk(file, "hri0", &hrirs);
+
+	build(hrirs);
+}
+
+HRTF::HRTF(std::vector< glm::vec3 > const &directions_, uint32_t length_, std::vector< float > const &hrirs) : directions(directions_), length(length_) {
+	build(hrirs);
+}
+
+void HRTF::build(std::vector< float > const &hrirs) {
+	if (directions.empty() || length == 0) {
+		throw std::runtime_error("HRTF should have at least one direction and a non-zero length.");
+	}
+	if (hrirs.size() != directions.size() * 2 * length) {
+		throw std::runtime_error("HRTF has " + std::to_string(hrirs.size()) + " impulse response values, but "
+			+ std::to_string(directions.size()) + " directions of " + std::to_string(length) + " frames need "
+			+ std::to_string(directions.size() * 2 * length) + ".");
+	}
+	for (auto &direction : directions) {
+		float len = glm::length(direction);
+		if (!(len > 0.0f)) throw std::runtime_error("HRTF has a zero-length direction.");
+		direction /= len;
+	}
+
+	partitions = (length + Partition - 1) / Partition;
+	spectra.assign(directions.size() * filter_floats(), 0.0f);
+
+	//each partition is zero-padded to twice its length (the overlap-save transform size) and transformed:
+	std::vector< float > frame(2 * Partition);
+	for (size_t d = 0; d < directions.size(); ++d) {
+		for (uint32_t ear = 0; ear < 2; ++ear) {
+			float const *hrir = hrirs.data() + (d * 2 + ear) * length;
+			for (uint32_t p = 0; p < partitions; ++p) {
+				std::fill(frame.begin(), frame.end(), 0.0f);
+				uint32_t begin = p * Partition;
+				uint32_t end = std::min(length, begin + Partition);
+				std::copy(hrir + begin, hrir + end, frame.begin());
+				float *spectrum = spectra.data() + d * filter_floats() + (ear * partitions + p) * 2 * Bins;
+				fft.forward(frame.data(), spectrum, spectrum + Bins);
+			}
+		}
+	}
+}
+
+HRTF HRTF::spherical_head(uint32_t count, uint32_t length) {
+	constexpr double Pi = 3.14159265358979323846;
+	constexpr double Rate = 48000.0;
+	constexpr double HeadRadius = 0.0875; //meters
+	constexpr double SpeedOfSound = 343.0; //meters per second
+	double const head_delay = HeadRadius / SpeedOfSound; //seconds
+
+	//spread directions over the sphere with a Fibonacci spiral:
+	std::vector< glm::vec3 > directions;
+	directions.reserve(count);
+	double const golden_angle = Pi * (3.0 - std::sqrt(5.0));
+	for (uint32_t i = 0; i < count; ++i) {
+		double z = 1.0 - 2.0 * (i + 0.5) / count;
+		double r = std::sqrt(1.0 - z * z);
+		double a = golden_angle * i;
+		directions.emplace_back(float(r * std::cos(a)), float(r * std::sin(a)), float(z));
+	}
+
+	std::vector< float > hrirs(size_t(count) * 2 * length, 0.0f);
+	for (uint32_t i = 0; i < count; ++i) {
+		for (uint32_t ear = 0; ear < 2; ++ear) {
+			float *hrir = hrirs.data() + (size_t(i) * 2 + ear) * length;
+			glm::vec3 ear_axis = glm::vec3(ear == 0 ? -1.0f : 1.0f, 0.0f, 0.0f);
+
+			//angle between the source and the ear:
+			double theta = std::acos(std::max(-1.0, std::min(1.0, double(glm::dot(directions[i], ear_axis)))));
+
+			//Woodworth's interaural delay (plus a fixed lead-in, so delays are never negative):
+			double delay = (theta < 0.5 * Pi ? -head_delay * std::cos(theta) : head_delay * (theta - 0.5 * Pi));
+			delay = (delay + head_delay) * Rate + 16.0; //in frames
+			if (delay + 8.0 >= length) throw std::runtime_error("HRTF length is too short for the head model's delays.");
+
+			//fractional delay by (Hann-windowed) sinc:
+			for (int32_t t = int32_t(std::floor(delay)) - 7; t <= int32_t(std::floor(delay)) + 8; ++t) {
+				double x = t - delay;
+				double sinc = (x == 0.0 ? 1.0 : std::sin(Pi * x) / (Pi * x));
+				double window = 0.5 + 0.5 * std::cos(Pi * x / 8.0);
+				hrir[t] = float(sinc * window);
+			}
+
+			//Brown and Duda's head shadow: a one-pole, one-zero filter that lifts high frequencies on the
+			// near side and cuts them on the far side (bilinear transform of (1 + a s / 2w) / (1 + s / 2w)):
+			double alpha = 1.05 + 0.95 * std::cos(theta / (150.0 / 180.0 * Pi) * Pi);
+			double k = Rate * head_delay; //(= Rate / w, with w = c / a)
+			double b0 = (1.0 + alpha * k) / (1.0 + k);
+			double b1 = (1.0 - alpha * k) / (1.0 + k);
+			double a1 = (1.0 - k) / (1.0 + k);
+			double x1 = 0.0, y1 = 0.0;
+			for (uint32_t t = 0; t < length; ++t) {
+				double x = hrir[t];
+				double y = b0 * x + b1 * x1 - a1 * y1;
+				x1 = x;
+				y1 = y;
+				//(scaled by 1/sqrt(2), the gain each channel of a centered 2D voice gets)
+				hrir[t] = float(y * std::sqrt(0.5));
+			}
+		}
+	}
+
+	return HRTF(directions, length, hrirs);
+}
+
+void HRTF::interpolate(glm::vec3 const &direction, float *filter) const {
+	//find the four nearest directions (largest dot products), nearest first:
+	uint32_t nearest[4] = {0, 0, 0, 0};
+	float nearest_dot[4] = {-2.0f, -2.0f, -2.0f, -2.0f};
+	for (uint32_t d = 0; d < uint32_t(directions.size()); ++d) {
+		float dot = glm::dot(direction, directions[d]);
+		if (dot <= nearest_dot[3]) continue;
+		uint32_t at = 3;
+		while (at > 0 && dot > nearest_dot[at-1]) {
+			nearest[at] = nearest[at-1];
+			nearest_dot[at] = nearest_dot[at-1];
+			--at;
+		}
+		nearest[at] = d;
+		nearest_dot[at] = dot;
+	}
+
+	//weight the three nearest by inverse angle, less the inverse angle of the fourth --
+	// so a direction's weight fades to zero before it drops out of the nearest three:
+	uint32_t const count = std::min< uint32_t >(3, uint32_t(directions.size()));
+	float angle[4];
+	for (uint32_t n = 0; n < 4; ++n) {
+		angle[n] = std::acos(std::max(-1.0f, std::min(1.0f, nearest_dot[n])));
+	}
+	float weights[3] = {1.0f, 0.0f, 0.0f};
+	if (angle[0] > 1e-4f) {
+		float cutoff = (directions.size() > 3 ? 1.0f / angle[3] : 0.0f);
+		float total = 0.0f;
+		for (uint32_t n = 0; n < count; ++n) {
+			weights[n] = std::max(0.0f, 1.0f / angle[n] - cutoff);
+			total += weights[n];
+		}
+		if (total > 0.0f) {
+			for (uint32_t n = 0; n < count; ++n) weights[n] /= total;
+		} else {
+			weights[0] = 1.0f; //(ties all the way down; just use the nearest)
+			weights[1] = weights[2] = 0.0f;
+		}
+	}
+
+	uint32_t const floats = filter_floats();
+	float const *first = spectra.data() + size_t(nearest[0]) * floats;
+	for (uint32_t f = 0; f < floats; ++f) {
+		filter[f] = weights[0] * first[f];
+	}
+	for (uint32_t n = 1; n < count; ++n) {
+		if (weights[n] == 0.0f) continue;
+		float const *spectrum = spectra.data() + size_t(nearest[n]) * floats;
+		for (uint32_t f = 0; f < floats; ++f) {
+			filter[f] += weights[n] * spectrum[f];
+		}
+	}
+}
+
+HRTFConvolver::HRTFConvolver(HRTF const &hrtf) :
+	history(HRTF::Partition, 0.0f),
+	input_spectra(size_t(hrtf.partitions) * 2 * HRTF::Bins, 0.0f),
+	filter(hrtf.filter_floats(), 0.0f),
+	previous_filter(hrtf.filter_floats(), 0.0f) {
+}
+
+void HRTFConvolver::convolve(HRTF const &hrtf, float const *filter_, uint32_t ear, float *wet) {
+	constexpr uint32_t const Bins = HRTF::Bins;
+	float re[Bins], im[Bins];
+	std::fill(re, re + Bins, 0.0f);
+	std::fill(im, im + Bins, 0.0f);
+
+	//output spectrum is the sum of each input spectrum times the filter partition of matching age:
+	uint32_t const partitions = hrtf.partitions;
+	for (uint32_t p = 0; p < partitions; ++p) {
+		float const *x = input_spectra.data() + size_t((newest + partitions - p) % partitions) * 2 * Bins;
+		float const *h = filter_ + size_t(ear * partitions + p) * 2 * Bins;
+		complex_multiply_add(x, x + Bins, h, h + Bins, Bins, re, im);
+	}
+
+	//(overlap-save: only the second half of the transformed-back frame is free of wrap-around)
+	float frame[2 * HRTF::Partition];
+	hrtf.fft.inverse(re, im, frame);
+	std::copy(frame + HRTF::Partition, frame + 2 * HRTF::Partition, wet);
+}
+
+void HRTFConvolver::process(HRTF const &hrtf, float const *in, uint32_t count, glm::vec3 const &from, glm::vec3 const &to, float *out) {
+	constexpr uint32_t const Partition = HRTF::Partition;
+	constexpr uint32_t const Bins = HRTF::Bins;
+	assert(count % Partition == 0);
+	assert(filter.size() == hrtf.filter_floats()); //(convolver should be sized for this HRTF)
+
+	if (needs_reset) {
+		std::fill(history.begin(), history.end(), 0.0f);
+		std::fill(input_spectra.begin(), input_spectra.end(), 0.0f);
+		has_filter = false;
+		needs_reset = false;
+	}
+
+	//(filters are remade once the direction moves more than a degree)
+	float const MaxDrift = std::cos(1.0f / 180.0f * 3.1415926f);
+
+	for (uint32_t begin = 0; begin < count; begin += Partition) {
+		//direction at the middle of this partition:
+		glm::vec3 direction = glm::mix(from, to, (begin + 0.5f * Partition) / count);
+		float len = glm::length(direction);
+		direction = (len > 0.0f ? direction / len : glm::vec3(0.0f, 1.0f, 0.0f));
+
+		bool crossfade = false;
+		if (!has_filter || glm::dot(direction, filter_direction) < MaxDrift) {
+			if (has_filter) {
+				std::swap(filter, previous_filter);
+				crossfade = true;
+			}
+			hrtf.interpolate(direction, filter.data());
+			filter_direction = direction;
+			has_filter = true;
+		}
+
+		//transform the previous and current partitions of input:
+		float frame[2 * Partition];
+		std::copy(history.begin(), history.end(), frame);
+		std::copy(in + begin, in + begin + Partition, frame + Partition);
+		std::copy(in + begin, in + begin + Partition, history.begin());
+		newest = (newest + 1) % hrtf.partitions;
+		float *spectrum = input_spectra.data() + size_t(newest) * 2 * Bins;
+		hrtf.fft.forward(frame, spectrum, spectrum + Bins);
+
+		for (uint32_t ear = 0; ear < 2; ++ear) {
+			float wet[Partition];
+			convolve(hrtf, filter.data(), ear, wet);
+			float *dst = out + 2 * begin + ear;
+			if (crossfade) {
+				float old[Partition];
+				convolve(hrtf, previous_filter.data(), ear, old);
+				for (uint32_t i = 0; i < Partition; ++i) {
+					float t = (i + 0.5f) / Partition;
+					dst[2*i] += old[i] + t * (wet[i] - old[i]);
+				}
+			} else {
+				for (uint32_t i = 0; i < Partition; ++i) {
+					dst[2*i] += wet[i];
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+/*
+ * An HRTF holds a set of head-related impulse responses (one left/right pair per
+ *  measured direction), used by Sound to play 3D voices binaurally (see Sound::set_hrtf).
+ *
+ * Directions are in listener space: +x is the listener's right, +y is straight
+ *  ahead, and +z is up.
+ *
+ * Impulse responses are split into partitions of HRTF::Partition frames and kept
+ *  as spectra, so an HRTFConvolver can filter a voice with a uniformly partitioned
+ *  overlap-save convolution: each partition of input is transformed once, and the
+ *  output spectrum is the sum of (recent input spectra x filter partitions).
+ *
+ * Filters for directions between measured ones are interpolated from the three
+ *  nearest measured directions. Sets with dense directions (or minimum-phase
+ *  responses) interpolate best.
+ *
+ * HRTF files ('.hrtf') hold three chunks (see read_write_chunk.hpp):
+ *   hrh0: one header { uint32_t rate; uint32_t length; } -- rate must be 48000
+ *   hrd0: directions (glm::vec3; normalized when loaded)
+ *   hri0: float impulse responses: for each direction, 'length' left then 'length' right values
+ */
+
+#include "fft.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct HRTF {
+	//frames per partition (and so per convolution step); Sound blocks are always a multiple of this:
+	static constexpr uint32_t const Partition = 128;
+	//bins in the spectrum of a (zero-padded, 2 * Partition) partition:
+	static constexpr uint32_t const Bins = Partition + 1;
+
+	//load from an '.hrtf' file:
+	// note: will throw if the file can't be read or doesn't make sense.
+	HRTF(std::string const &filename);
+
+	//build from impulse responses laid out as in the 'hri0' chunk above:
+	HRTF(std::vector< glm::vec3 > const &directions, uint32_t length, std::vector< float > const &hrirs);
+
+	//a simple spherical head model (interaural delay and head shadow, no ear or torso cues),
+	// with 'count' directions spread evenly over the sphere -- handy when no measured set is around:
+	static HRTF spherical_head(uint32_t count = 1024, uint32_t length = 256);
+
+	//floats in one direction's filter: [ear][partition][real Bins | imaginary Bins]
+	uint32_t filter_floats() const { return 2 * partitions * 2 * Bins; }
+
+	//write the filter for (unit) 'direction', interpolated from the nearest measured directions, to 'filter':
+	// (filter_floats() values; doesn't allocate, so is fine to call from the audio callback)
+	void interpolate(glm::vec3 const &direction, float *filter) const;
+
+	//-- internals ---
+
+	//(called by the constructors) normalize directions, check sizes, and build 'spectra':
+	void build(std::vector< float > const &hrirs);
+
+	std::vector< glm::vec3 > directions;
+	uint32_t length = 0; //frames per impulse response
+	uint32_t partitions = 0; //partitions per impulse response
+	std::vector< float > spectra; //filter_floats() values per direction
+	RealFFT fft = RealFFT(2 * Partition);
+};
+
+//Convolution state for one voice: recent input spectra, and the filter in use.
+struct HRTFConvolver {
+	HRTFConvolver() = default;
+	HRTFConvolver(HRTF const &hrtf); //(sized for 'hrtf')
+
+	//forget any previous input (e.g., when the voice starts a new sound); takes effect on the next process():
+	void reset() { needs_reset = true; }
+
+	//filter 'count' (a multiple of HRTF::Partition) mono frames from 'in', adding the result to interleaved
+	// stereo 'out'. The source moves from direction 'from' to 'to' (listener space) over the frames:
+	// the filter is updated whenever the direction moves more than a degree or so, and old and new filter
+	// outputs are crossfaded over a partition.
+	void process(HRTF const &hrtf, float const *in, uint32_t count, glm::vec3 const &from, glm::vec3 const &to, float *out);
+
+	//-- internals ---
+
+	//filter the newest input spectrum (and those before it) by one ear of 'filter', writing a partition to 'wet':
+	void convolve(HRTF const &hrtf, float const *filter, uint32_t ear, float *wet);
+
+	std::vector< float > history; //previous partition of input
+	std::vector< float > input_spectra; //the last 'partitions' input spectra, each [real Bins | imaginary Bins]
+	uint32_t newest = 0; //index of the newest input spectrum
+	std::vector< float > filter; //current filter (HRTF::filter_floats() values)
+	std::vector< float > previous_filter; //filter being crossfaded from
+	glm::vec3 filter_direction = glm::vec3(0.0f); //direction 'filter' was made for
+	bool has_filter = false;
+	bool needs_reset = true;
+};
@@ -13,8 +13,6 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 	auto &data = *data_;
 	data.clear();
 
-	std::cout << "loading '" << filename << "'..."; std::cout.flush();
-
 	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
 	int err = 0;
 	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
@@ -50,5 +48,7 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 		}
 	}
 
-	std::cout << " done." << std::endl;
+	//(one string, so lines from loaders running in parallel don't interleave)
+	std::cout << ("loaded '" + filename + "'.\n");
+	std::cout.flush();
 }
@@ -9,6 +9,7 @@
 
 //For sound init:
 #include "Sound.hpp"
+#include "bus_effects.hpp"
 
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
@@ -106,7 +107,16 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ init sound --------------
-	Sound::init();
+	//(start with short blocks, so letters sound right as keys are pressed; grows if the device can't keep up)
+	Sound::Latency latency;
+	latency.frames = 256;
+	latency.adaptive = true;
+	//(mix on a thread of our own a couple of buffers ahead, so a busy frame or a page fault doesn't crackle)
+	latency.mixer_thread = true;
+	latency.ahead = 2;
+	Sound::init(64, true, latency);
+	//(overlapping letter clips can add up past full scale, so limit the master bus rather than let it clip)
+	Sound::add_effect(Sound::MasterBus, std::make_shared< Limiter >());
 
 	//------------ load assets --------------
 	call_load_functions();
@@ -0,0 +1,398 @@
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define MIX_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//GCC and clang need to be told that a function may use AVX2 instructions;
+// MSVC allows any intrinsic anywhere:
+#if defined(__GNUC__) || defined(__clang__)
+#define MIX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MIX_TARGET_AVX2
+#endif
+
+void mix_mono_to_stereo_scalar(float const *src, uint32_t count, float *dst, float gain_l, float gain_r, float step_l, float step_r) {
+	for (uint32_t i = 0; i < count; ++i) {
+		float f = float(i);
+		dst[2*i+0] += (gain_l + f * step_l) * src[i];
+		dst[2*i+1] += (gain_r + f * step_r) * src[i];
+	}
+}
+
+//The resampler sums taps in four interleaved lanes (lane k gets taps k, k+4, k+8, ...),
+// then adds the lanes as (0+2) + (1+3) -- exactly the order the SSE2 version uses:
+void resample_polyphase_scalar(float const *src, uint64_t position, uint64_t step, float const *filter, uint32_t count, float *out) {
+	for (uint32_t k = 0; k < count; ++k, position += step) {
+		float const *s = src + (position >> 32);
+		float const *f = filter + ((position >> (32 - RESAMPLE_PHASE_BITS)) & (RESAMPLE_PHASES - 1)) * RESAMPLE_TAPS;
+		float lane[4];
+		for (uint32_t l = 0; l < 4; ++l) {
+			lane[l] = s[l] * f[l];
+		}
+		for (uint32_t t = 4; t < RESAMPLE_TAPS; t += 4) {
+			for (uint32_t l = 0; l < 4; ++l) {
+				lane[l] = lane[l] + s[t+l] * f[t+l];
+			}
+		}
+		out[k] = (lane[0] + lane[2]) + (lane[1] + lane[3]);
+	}
+}
+
+void convert_int16_to_float_scalar(int16_t const *src, uint32_t count, float *dst) {
+	for (uint32_t i = 0; i < count; ++i) {
+		dst[i] = float(src[i]) * (1.0f / 32768.0f);
+	}
+}
+
+void add_block_scalar(float const *src, uint32_t count, float *dst) {
+	for (uint32_t i = 0; i < count; ++i) {
+		dst[i] += src[i];
+	}
+}
+
+void complex_multiply_add_scalar(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	for (uint32_t i = 0; i < count; ++i) {
+		float re = a_re[i] * b_re[i] - a_im[i] * b_im[i];
+		float im = a_re[i] * b_im[i] + a_im[i] * b_re[i];
+		acc_re[i] += re;
+		acc_im[i] += im;
+	}
+}
+
+void fft_butterflies_scalar(float *a_re, float *a_im, float *b_re, float *b_im, float const *w_re, float const *w_im, float sign, uint32_t count) {
+	for (uint32_t k = 0; k < count; ++k) {
+		float wr = w_re[k];
+		float wi = sign * w_im[k];
+		float tr = b_re[k] * wr - b_im[k] * wi;
+		float ti = b_re[k] * wi + b_im[k] * wr;
+		b_re[k] = a_re[k] - tr;
+		b_im[k] = a_im[k] - ti;
+		a_re[k] += tr;
+		a_im[k] += ti;
+	}
+}
+
+#ifdef MIX_KERNELS_X86
+
+static void fft_butterflies_sse2(float *a_re, float *a_im, float *b_re, float *b_im, float const *w_re, float const *w_im, float sign, uint32_t count) {
+	__m128 const s = _mm_set1_ps(sign);
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 wr = _mm_loadu_ps(w_re + k);
+		__m128 wi = _mm_mul_ps(s, _mm_loadu_ps(w_im + k));
+		__m128 br = _mm_loadu_ps(b_re + k), bi = _mm_loadu_ps(b_im + k);
+		__m128 ar = _mm_loadu_ps(a_re + k), ai = _mm_loadu_ps(a_im + k);
+		__m128 tr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+		__m128 ti = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+		_mm_storeu_ps(b_re + k, _mm_sub_ps(ar, tr));
+		_mm_storeu_ps(b_im + k, _mm_sub_ps(ai, ti));
+		_mm_storeu_ps(a_re + k, _mm_add_ps(ar, tr));
+		_mm_storeu_ps(a_im + k, _mm_add_ps(ai, ti));
+	}
+	fft_butterflies_scalar(a_re + k, a_im + k, b_re + k, b_im + k, w_re + k, w_im + k, sign, count - k);
+}
+
+MIX_TARGET_AVX2
+static void fft_butterflies_avx2(float *a_re, float *a_im, float *b_re, float *b_im, float const *w_re, float const *w_im, float sign, uint32_t count) {
+	__m256 const s = _mm256_set1_ps(sign);
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 wr = _mm256_loadu_ps(w_re + k);
+		__m256 wi = _mm256_mul_ps(s, _mm256_loadu_ps(w_im + k));
+		__m256 br = _mm256_loadu_ps(b_re + k), bi = _mm256_loadu_ps(b_im + k);
+		__m256 ar = _mm256_loadu_ps(a_re + k), ai = _mm256_loadu_ps(a_im + k);
+		__m256 tr = _mm256_sub_ps(_mm256_mul_ps(br, wr), _mm256_mul_ps(bi, wi));
+		__m256 ti = _mm256_add_ps(_mm256_mul_ps(br, wi), _mm256_mul_ps(bi, wr));
+		_mm256_storeu_ps(b_re + k, _mm256_sub_ps(ar, tr));
+		_mm256_storeu_ps(b_im + k, _mm256_sub_ps(ai, ti));
+		_mm256_storeu_ps(a_re + k, _mm256_add_ps(ar, tr));
+		_mm256_storeu_ps(a_im + k, _mm256_add_ps(ai, ti));
+	}
+	//(the compiler doesn't clear the upper halves before a tail call, and leaving them dirty
+	// makes every non-AVX SSE instruction afterward -- i.e., the rest of the mixer -- slower)
+	_mm256_zeroupper();
+	fft_butterflies_sse2(a_re + k, a_im + k, b_re + k, b_im + k, w_re + k, w_im + k, sign, count - k);
+}
+
+static void complex_multiply_add_sse2(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 ar = _mm_loadu_ps(a_re + i), ai = _mm_loadu_ps(a_im + i);
+		__m128 br = _mm_loadu_ps(b_re + i), bi = _mm_loadu_ps(b_im + i);
+		__m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+		__m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+		_mm_storeu_ps(acc_re + i, _mm_add_ps(_mm_loadu_ps(acc_re + i), re));
+		_mm_storeu_ps(acc_im + i, _mm_add_ps(_mm_loadu_ps(acc_im + i), im));
+	}
+	complex_multiply_add_scalar(a_re + i, a_im + i, b_re + i, b_im + i, count - i, acc_re + i, acc_im + i);
+}
+
+MIX_TARGET_AVX2
+static void complex_multiply_add_avx2(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 ar = _mm256_loadu_ps(a_re + i), ai = _mm256_loadu_ps(a_im + i);
+		__m256 br = _mm256_loadu_ps(b_re + i), bi = _mm256_loadu_ps(b_im + i);
+		__m256 re = _mm256_sub_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi));
+		__m256 im = _mm256_add_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br));
+		_mm256_storeu_ps(acc_re + i, _mm256_add_ps(_mm256_loadu_ps(acc_re + i), re));
+		_mm256_storeu_ps(acc_im + i, _mm256_add_ps(_mm256_loadu_ps(acc_im + i), im));
+	}
+	_mm256_zeroupper(); //(see fft_butterflies_avx2)
+	complex_multiply_add_scalar(a_re + i, a_im + i, b_re + i, b_im + i, count - i, acc_re + i, acc_im + i);
+}
+
+static void add_block_sse2(float const *src, uint32_t count, float *dst) {
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+	}
+	for (; i < count; ++i) {
+		dst[i] += src[i];
+	}
+}
+
+MIX_TARGET_AVX2
+static void add_block_avx2(float const *src, uint32_t count, float *dst) {
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+	}
+	for (; i < count; ++i) {
+		dst[i] += src[i];
+	}
+}
+
+//eight samples per iteration (sign-extended to two __m128i of int32):
+static void convert_int16_to_float_sse2(int16_t const *src, uint32_t count, float *dst) {
+	__m128 const scale = _mm_set1_ps(1.0f / 32768.0f);
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i s = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16); //s0 .. s3
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16); //s4 .. s7
+		_mm_storeu_ps(dst + i + 0, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	for (; i < count; ++i) {
+		dst[i] = float(src[i]) * (1.0f / 32768.0f);
+	}
+}
+
+static void resample_polyphase_sse2(float const *src, uint64_t position, uint64_t step, float const *filter, uint32_t count, float *out) {
+	for (uint32_t k = 0; k < count; ++k, position += step) {
+		float const *s = src + (position >> 32);
+		float const *f = filter + ((position >> (32 - RESAMPLE_PHASE_BITS)) & (RESAMPLE_PHASES - 1)) * RESAMPLE_TAPS;
+		__m128 acc = _mm_mul_ps(_mm_loadu_ps(s), _mm_loadu_ps(f));
+		for (uint32_t t = 4; t < RESAMPLE_TAPS; t += 4) {
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(s + t), _mm_loadu_ps(f + t)));
+		}
+		__m128 pairs = _mm_add_ps(acc, _mm_movehl_ps(acc, acc)); //(0+2) (1+3) ...
+		__m128 sum = _mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1)));
+		out[k] = _mm_cvtss_f32(sum);
+	}
+}
+
+//two stereo frames per iteration (one __m128 holds LRLR):
+static void mix_mono_to_stereo_sse2(float const *src, uint32_t count, float *dst, float gain_l, float gain_r, float step_l, float step_r) {
+	__m128 const gain = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+	__m128 const step = _mm_setr_ps(step_l, step_r, step_l, step_r);
+	__m128 frame = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f); //frame index of each lane
+	__m128 const two = _mm_set1_ps(2.0f);
+	__m128 const four = _mm_set1_ps(4.0f);
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 s = _mm_loadu_ps(src + i);
+		__m128 s01 = _mm_unpacklo_ps(s, s); //s0 s0 s1 s1
+		__m128 s23 = _mm_unpackhi_ps(s, s); //s2 s2 s3 s3
+
+		__m128 g01 = _mm_add_ps(gain, _mm_mul_ps(frame, step));
+		__m128 g23 = _mm_add_ps(gain, _mm_mul_ps(_mm_add_ps(frame, two), step));
+
+		_mm_storeu_ps(dst + 2*i + 0, _mm_add_ps(_mm_loadu_ps(dst + 2*i + 0), _mm_mul_ps(g01, s01)));
+		_mm_storeu_ps(dst + 2*i + 4, _mm_add_ps(_mm_loadu_ps(dst + 2*i + 4), _mm_mul_ps(g23, s23)));
+
+		frame = _mm_add_ps(frame, four);
+	}
+
+	//leftover frames: (note that gain is based on absolute frame index)
+	for (; i < count; ++i) {
+		float f = float(i);
+		dst[2*i+0] += (gain_l + f * step_l) * src[i];
+		dst[2*i+1] += (gain_r + f * step_r) * src[i];
+	}
+}
+
+//four stereo frames per iteration (one __m256 holds LRLRLRLR):
+MIX_TARGET_AVX2
+static void mix_mono_to_stereo_avx2(float const *src, uint32_t count, float *dst, float gain_l, float gain_r, float step_l, float step_r) {
+	__m256 const gain = _mm256_setr_ps(gain_l, gain_r, gain_l, gain_r, gain_l, gain_r, gain_l, gain_r);
+	__m256 const step = _mm256_setr_ps(step_l, step_r, step_l, step_r, step_l, step_r, step_l, step_r);
+	__m256 frame = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+	__m256 const four = _mm256_set1_ps(4.0f);
+	__m256 const eight = _mm256_set1_ps(8.0f);
+	__m256i const lo_dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	__m256i const hi_dup = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 s = _mm256_loadu_ps(src + i);
+		__m256 s0123 = _mm256_permutevar8x32_ps(s, lo_dup); //s0 s0 s1 s1 s2 s2 s3 s3
+		__m256 s4567 = _mm256_permutevar8x32_ps(s, hi_dup); //s4 s4 ... s7 s7
+
+		__m256 g0123 = _mm256_add_ps(gain, _mm256_mul_ps(frame, step));
+		__m256 g4567 = _mm256_add_ps(gain, _mm256_mul_ps(_mm256_add_ps(frame, four), step));
+
+		_mm256_storeu_ps(dst + 2*i + 0, _mm256_add_ps(_mm256_loadu_ps(dst + 2*i + 0), _mm256_mul_ps(g0123, s0123)));
+		_mm256_storeu_ps(dst + 2*i + 8, _mm256_add_ps(_mm256_loadu_ps(dst + 2*i + 8), _mm256_mul_ps(g4567, s4567)));
+
+		frame = _mm256_add_ps(frame, eight);
+	}
+
+	for (; i < count; ++i) {
+		float f = float(i);
+		dst[2*i+0] += (gain_l + f * step_l) * src[i];
+		dst[2*i+1] += (gain_r + f * step_r) * src[i];
+	}
+}
+
+static bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!(osxsave && avx)) return false;
+	if ((_xgetbv(0) & 0x6) != 0x6) return false; //OS must save ymm registers
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+#endif //MIX_KERNELS_X86
+
+namespace {
+	typedef void (*MixFn)(float const *, uint32_t, float *, float, float, float, float);
+	typedef void (*ResampleFn)(float const *, uint64_t, uint64_t, float const *, uint32_t, float *);
+	typedef void (*ConvertFn)(int16_t const *, uint32_t, float *);
+	typedef void (*AddFn)(float const *, uint32_t, float *);
+	typedef void (*ComplexMacFn)(float const *, float const *, float const *, float const *, uint32_t, float *, float *);
+	typedef void (*ButterflyFn)(float *, float *, float *, float *, float const *, float const *, float, uint32_t);
+
+	struct Kernel {
+		MixFn fn;
+		ResampleFn resample;
+		ConvertFn convert;
+		AddFn add;
+		ComplexMacFn complex_mac;
+		ButterflyFn butterflies;
+		char const *name;
+	};
+
+	Kernel pick_kernel() {
+#ifdef MIX_KERNELS_X86
+		//(a wider resampler doesn't help much -- 32 taps is only a few 4-wide steps -- and conversion is memory-bound)
+		if (cpu_has_avx2()) return Kernel{ mix_mono_to_stereo_avx2, resample_polyphase_sse2, convert_int16_to_float_sse2, add_block_avx2, complex_multiply_add_avx2, fft_butterflies_avx2, "avx2" };
+		return Kernel{ mix_mono_to_stereo_sse2, resample_polyphase_sse2, convert_int16_to_float_sse2, add_block_sse2, complex_multiply_add_sse2, fft_butterflies_sse2, "sse2" };
+#else
+		return Kernel{ mix_mono_to_stereo_scalar, resample_polyphase_scalar, convert_int16_to_float_scalar, add_block_scalar, complex_multiply_add_scalar, fft_butterflies_scalar, "scalar" };
+#endif
+	}
+
+	//function-local static so the choice is made on first use, safely, from any thread:
+	Kernel const &kernel() {
+		static Kernel const k = pick_kernel();
+		return k;
+	}
+}
+
+void mix_mono_to_stereo(float const *src, uint32_t count, float *dst, float gain_l, float gain_r, float step_l, float step_r) {
+	kernel().fn(src, count, dst, gain_l, gain_r, step_l, step_r);
+}
+
+void resample_polyphase(float const *src, uint64_t position, uint64_t step, float const *filter, uint32_t count, float *out) {
+	kernel().resample(src, position, step, filter, count, out);
+}
+
+void convert_int16_to_float(int16_t const *src, uint32_t count, float *dst) {
+	kernel().convert(src, count, dst);
+}
+
+void add_block(float const *src, uint32_t count, float *dst) {
+	kernel().add(src, count, dst);
+}
+
+void complex_multiply_add(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	kernel().complex_mac(a_re, a_im, b_re, b_im, count, acc_re, acc_im);
+}
+
+void fft_butterflies(float *a_re, float *a_im, float *b_re, float *b_im, float const *w_re, float const *w_im, float sign, uint32_t count) {
+	kernel().butterflies(a_re, a_im, b_re, b_im, w_re, w_im, sign, count);
+}
+
+namespace {
+	//cutoffs (as a fraction of the source Nyquist frequency) of the prepared filter tables:
+	// (a bit below 1.0 to leave room for the transition band of a 32-tap filter)
+	constexpr std::array< double, 7 > const FilterCutoffs = {0.9, 0.72, 0.58, 0.45, 0.36, 0.29, 0.22};
+
+	std::vector< float > build_filter(double cutoff) {
+		constexpr double Pi = 3.14159265358979323846;
+		constexpr double Half = RESAMPLE_TAPS / 2;
+		std::vector< float > table(RESAMPLE_PHASES * RESAMPLE_TAPS);
+		for (uint32_t p = 0; p < RESAMPLE_PHASES; ++p) {
+			double frac = double(p) / RESAMPLE_PHASES;
+			std::array< double, RESAMPLE_TAPS > taps;
+			double sum = 0.0;
+			for (uint32_t t = 0; t < RESAMPLE_TAPS; ++t) {
+				//distance from the point being interpolated to source sample 't':
+				double x = (double(t) - (Half - 1.0)) - frac;
+				double sinc = (x == 0.0 ? 1.0 : std::sin(Pi * cutoff * x) / (Pi * cutoff * x));
+				double window = 0.42 + 0.5 * std::cos(Pi * x / Half) + 0.08 * std::cos(2.0 * Pi * x / Half); //Blackman
+				taps[t] = (std::abs(x) < Half ? sinc * window : 0.0);
+				sum += taps[t];
+			}
+			for (uint32_t t = 0; t < RESAMPLE_TAPS; ++t) {
+				table[p * RESAMPLE_TAPS + t] = float(taps[t] / sum);
+			}
+		}
+		return table;
+	}
+}
+
+float const *resample_filter(double rate) {
+	static std::array< std::vector< float >, FilterCutoffs.size() > const filters = [](){
+		std::array< std::vector< float >, FilterCutoffs.size() > ret;
+		for (uint32_t i = 0; i < FilterCutoffs.size(); ++i) {
+			ret[i] = build_filter(FilterCutoffs[i]);
+		}
+		return ret;
+	}();
+	//pick the widest filter that is narrow enough for this rate:
+	double want = FilterCutoffs[0] / std::max(1.0, rate);
+	for (uint32_t i = 0; i < FilterCutoffs.size(); ++i) {
+		if (FilterCutoffs[i] <= want * 1.0001) return filters[i].data();
+	}
+	return filters.back().data();
+}
+
+char const *mix_kernel_name() {
+	return kernel().name;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+
+//Block mixing kernels used by Sound's mix_audio callback.
+//  The best kernel for the running CPU (AVX2, SSE2, or plain scalar) is chosen once at startup.
+
+//Polyphase resampling filters are RESAMPLE_TAPS long, with 2^RESAMPLE_PHASE_BITS phases:
+constexpr uint32_t const RESAMPLE_TAPS = 32;
+constexpr uint32_t const RESAMPLE_PHASE_BITS = 8;
+constexpr uint32_t const RESAMPLE_PHASES = 1 << RESAMPLE_PHASE_BITS;
+
+//Mix 'count' mono samples from 'src' into interleaved stereo (LRLR...) 'dst'.
+//  Frame 'i' is scaled by (gain + i * step) on each channel, so gain ramps linearly across the span.
+//  All kernels compute the gain this same way (multiply then add, no fused ops),
+//  so they agree with each other up to float summation order in 'dst'.
+void mix_mono_to_stereo(
+	float const *src, uint32_t count,
+	float *dst,
+	float gain_l, float gain_r,
+	float step_l, float step_r
+);
+
+//The reference (scalar) version of the kernel above; handy for checking the vector versions:
+void mix_mono_to_stereo_scalar(
+	float const *src, uint32_t count,
+	float *dst,
+	float gain_l, float gain_r,
+	float step_l, float step_r
+);
+
+//Resample by windowed-sinc polyphase filter, producing 'count' samples in 'out'.
+//  Positions are 32.32 fixed point: output k is read at 'position + k * step'.
+//  For a position p, src[p >> 32] ... src[(p >> 32) + RESAMPLE_TAPS - 1] are read, and the output is
+//  the signal at src[(p >> 32) + RESAMPLE_TAPS/2 - 1] plus the fractional part of p.
+//  'filter' comes from resample_filter(). Like the mixing kernels, all versions give identical results.
+void resample_polyphase(
+	float const *src, uint64_t position, uint64_t step,
+	float const *filter, uint32_t count,
+	float *out
+);
+
+//The reference (scalar) version of the resampler:
+void resample_polyphase_scalar(
+	float const *src, uint64_t position, uint64_t step,
+	float const *filter, uint32_t count,
+	float *out
+);
+
+//Filter table (RESAMPLE_PHASES x RESAMPLE_TAPS, normalized to unity gain) for playing back at 'rate' times
+//  the source rate: rates above 1 get a lower cutoff so they don't alias.
+//  (tables are built on first use; call once from the main thread to avoid doing that in the audio callback)
+float const *resample_filter(double rate);
+
+//Convert 'count' 16-bit samples to floats in [-1,1) (scaled by 1/32768, so all versions agree exactly):
+//  (used to decode Sound::Sample data kept resident as int16 or ADPCM)
+void convert_int16_to_float(int16_t const *src, uint32_t count, float *dst);
+
+//The reference (scalar) version of the conversion:
+void convert_int16_to_float_scalar(int16_t const *src, uint32_t count, float *dst);
+
+//Add 'count' floats from 'src' into 'dst' (dst[i] += src[i]; every version sums identically):
+//  (used to sum the blocks mixed by Sound's worker threads)
+void add_block(float const *src, uint32_t count, float *dst);
+
+//The reference (scalar) version of the sum:
+void add_block_scalar(float const *src, uint32_t count, float *dst);
+
+//Complex multiply-accumulate over 'count' values kept as separate real and imaginary arrays:
+//  acc[i] += a[i] * b[i]. Computed as (ar*br - ai*bi) and (ar*bi + ai*br), then added (no fused ops),
+//  so all versions agree exactly. (used by the HRTF convolver to filter spectra, see hrtf.hpp)
+void complex_multiply_add(
+	float const *a_re, float const *a_im,
+	float const *b_re, float const *b_im,
+	uint32_t count,
+	float *acc_re, float *acc_im
+);
+
+//The reference (scalar) version of the multiply-accumulate:
+void complex_multiply_add_scalar(
+	float const *a_re, float const *a_im,
+	float const *b_re, float const *b_im,
+	uint32_t count,
+	float *acc_re, float *acc_im
+);
+
+//One group of radix-2 FFT butterflies over 'count' values kept as separate real and imaginary arrays:
+//  t = b[k] * (w_re[k] + i * sign * w_im[k]); b[k] = a[k] - t; a[k] += t. All versions agree exactly.
+//  (used by RealFFT, see fft.hpp)
+void fft_butterflies(
+	float *a_re, float *a_im,
+	float *b_re, float *b_im,
+	float const *w_re, float const *w_im, float sign,
+	uint32_t count
+);
+
+//The reference (scalar) version of the butterflies:
+void fft_butterflies_scalar(
+	float *a_re, float *a_im,
+	float *b_re, float *b_im,
+	float const *w_re, float const *w_im, float sign,
+	uint32_t count
+);
+
+//Name of the kernel being used by mix_mono_to_stereo ("avx2", "sse2", or "scalar"):
+char const *mix_kernel_name();
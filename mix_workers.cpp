@@ -0,0 +1,150 @@
+#include "mix_workers.hpp"
+
+#include <cassert>
+#include <chrono>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define MIX_WORKERS_PAUSE() _mm_pause()
+#else
+#define MIX_WORKERS_PAUSE() std::this_thread::yield()
+#endif
+
+namespace {
+	//how long a worker at normal priority keeps checking for a new job before it goes to sleep:
+	// (about a millisecond of pauses -- long enough to catch the next block when blocks are short;
+	//  real-time workers don't spin at all -- see match_priority)
+	constexpr uint32_t const SpinChecks = 20000;
+
+	//how long run() spins waiting for claimed chunks before it sleeps instead:
+	// (about a tenth of SpinChecks -- several chunks' worth of mixing)
+	constexpr uint32_t const WaitSpinChecks = 2000;
+}
+
+MixWorkers::MixWorkers(uint32_t count) {
+	//(workers aren't pinned: the thread running the callback can't be pinned from here, so a pinned
+	// worker could end up sharing its core for good -- the scheduler can move them apart instead)
+	threads.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		threads.emplace_back(&MixWorkers::worker_main, this);
+	}
+}
+
+MixWorkers::~MixWorkers() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+void MixWorkers::run(Job job_, void *context_, uint32_t chunks) {
+	assert(chunks <= 0xffff);
+	if (chunks == 0) return;
+
+	job = job_;
+	context = context_;
+	done_chunks.store(0, std::memory_order_relaxed);
+	uint64_t generation = (claims.load(std::memory_order_relaxed) >> 32) + 1;
+	claims.store((generation << 32) | (uint64_t(chunks) << 16), std::memory_order_release);
+
+	//workers that are spinning see the new job right away; sleeping ones need waking:
+	// (notify without holding the mutex so the callback never blocks on it; a worker that
+	//  misses the wakeup just sleeps through this job, and the chunks get done without it)
+	if (!threads.empty()) wake.notify_all();
+
+	work();
+
+	//wait for chunks that other threads claimed:
+	uint32_t checks = 0;
+	while (done_chunks.load(std::memory_order_acquire) < chunks) {
+		if (checks < WaitSpinChecks) {
+			++checks;
+			MIX_WORKERS_PAUSE();
+			continue;
+		}
+		//still waiting -- maybe on a worker that can't run while this thread holds its core, so sleep:
+		// (workers notify without the mutex, so a notify can slip in before the wait; hence the timeout)
+		std::unique_lock< std::mutex > lock(mutex);
+		if (done_chunks.load(std::memory_order_acquire) >= chunks) break;
+		finished.wait_for(lock, std::chrono::microseconds(100));
+	}
+}
+
+bool MixWorkers::match_priority() {
+#if defined(__linux__) || defined(__APPLE__)
+	int policy;
+	sched_param param;
+	if (pthread_getschedparam(pthread_self(), &policy, &param) != 0) return false;
+	bool matched = true;
+	for (auto &thread : threads) {
+		if (pthread_setschedparam(thread.native_handle(), policy, &param) != 0) matched = false;
+	}
+	spin.store(policy != SCHED_FIFO && policy != SCHED_RR, std::memory_order_relaxed);
+	return matched;
+#elif defined(_WIN32)
+	int priority = GetThreadPriority(GetCurrentThread());
+	bool matched = true;
+	for (auto &thread : threads) {
+		if (!SetThreadPriority(thread.native_handle(), priority)) matched = false;
+	}
+	spin.store(priority <= THREAD_PRIORITY_NORMAL, std::memory_order_relaxed);
+	return matched;
+#else
+	return false;
+#endif
+}
+
+void MixWorkers::work() {
+	uint64_t word = claims.load(std::memory_order_acquire);
+	for (;;) {
+		uint32_t next = uint32_t(word & 0xffff);
+		uint32_t chunks = uint32_t((word >> 16) & 0xffff);
+		if (next >= chunks) return;
+		if (!claims.compare_exchange_weak(word, word + 1, std::memory_order_acq_rel, std::memory_order_acquire)) continue;
+		//(the job can't change until this chunk is done, since run() waits for it)
+		job(context, next);
+		if (done_chunks.fetch_add(1, std::memory_order_release) + 1 == chunks) {
+			finished.notify_one(); //(in case run() is asleep waiting for this one)
+		}
+		word = claims.load(std::memory_order_acquire);
+	}
+}
+
+void MixWorkers::worker_main() {
+	uint64_t seen = claims.load(std::memory_order_acquire) >> 32;
+	for (;;) {
+		//spin for a bit (at normal priority), then sleep, until there's a new job:
+		uint32_t checks = (spin.load(std::memory_order_relaxed) ? 0 : SpinChecks);
+		while ((claims.load(std::memory_order_acquire) >> 32) == seen) {
+			if (checks < SpinChecks) {
+				++checks;
+				MIX_WORKERS_PAUSE();
+				continue;
+			}
+			std::unique_lock< std::mutex > lock(mutex);
+			if (quit) return;
+			//(no timeout: a notify that slips in between the check and the wait only costs this job, since the next run() notifies again)
+			wake.wait(lock);
+			if (quit) return;
+		}
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+			if (quit) return;
+		}
+		seen = claims.load(std::memory_order_acquire) >> 32;
+		work();
+	}
+}
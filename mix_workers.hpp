@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+ * MixWorkers is a small pool of threads that help the audio callback mix a block.
+ *
+ * run() splits a job into chunks: the calling thread (the audio callback) and the
+ *  workers all claim chunks from a shared counter until none are left, then the
+ *  caller waits for any chunks still being worked on.
+ * Because the caller claims chunks too, a block never waits on a worker that
+ *  hasn't woken up yet -- at worst the caller mixes everything itself, as if
+ *  there were no workers at all.
+ * Waiting for chunks that workers did claim spins only briefly, then sleeps, so a
+ *  caller at a higher priority (e.g., a real-time mixer thread) can't keep a worker
+ *  it shares a core with from finishing. match_priority() closes the gap the
+ *  rest of the way by running the workers at the caller's priority.
+ *
+ * Workers spin briefly after each job (blocks arrive every few milliseconds),
+ *  then sleep until the next one -- unless match_priority() has made them
+ *  real-time, in which case they go straight to sleep, since a spinning
+ *  real-time thread keeps everything else off its core. Workers aren't pinned
+ *  to cores; the scheduler is free to keep them off whichever core the audio
+ *  callback is using.
+ *
+ * run() must only be called from one thread at a time.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct MixWorkers {
+	//start 'count' worker threads:
+	MixWorkers(uint32_t count);
+	~MixWorkers(); //(stops and joins the workers)
+
+	MixWorkers(MixWorkers const &) = delete;
+	MixWorkers &operator=(MixWorkers const &) = delete;
+
+	uint32_t size() const { return uint32_t(threads.size()); }
+
+	//call job(context, c) once for each chunk c in [0, chunks), spread over the caller and the workers;
+	// returns once every chunk is done. (at most 65535 chunks)
+	// (a plain function pointer, so handing off work never allocates)
+	typedef void (*Job)(void *context, uint32_t chunk);
+	void run(Job job_, void *context_, uint32_t chunks);
+
+	//run the workers at the calling thread's scheduling policy and priority (where the platform allows it):
+	// (if that is a real-time priority, workers stop spinning between jobs)
+	// returns false if the system wouldn't.
+	bool match_priority();
+
+	//-- internals ---
+
+	//claim and do chunks until none are left:
+	void work();
+	void worker_main();
+
+	//the current job (written by run() before 'claims' is published):
+	Job job = nullptr;
+	void *context = nullptr;
+
+	//(job generation << 32) | (chunks << 16) | (next chunk to claim)
+	// claiming is a compare-exchange on the whole word, so a worker that is slow off the mark
+	// can never claim a chunk of a later job by mistake:
+	std::atomic< uint64_t > claims{0};
+	std::atomic< uint32_t > done_chunks{0};
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished; //notified when a job's last chunk is done (for a run() that stopped spinning)
+	bool quit = false; //(protected by mutex)
+	std::atomic< bool > spin{true}; //do workers spin for a new job before sleeping? (see match_priority)
+
+	std::vector< std::thread > threads;
+};
@@ -0,0 +1,193 @@
+#include "opus_stream.hpp"
+#include "spsc_ring.hpp"
+
+#include <opusfile.h>
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	//Stream state transitions:
+	//   Free     --(game: open)-->          Requested
+	//   Requested --(worker: file opened)--> Active
+	//   Requested/Active --(owner: release)--> Released
+	//   Released --(worker: cleaned up)-->   Free
+	enum StreamState : uint32_t {
+		StreamFree = 0,
+		StreamRequested = 1,
+		StreamActive = 2,
+		StreamReleased = 3,
+	};
+
+	struct Stream {
+		std::atomic< uint32_t > state{StreamFree};
+
+		//set by the game thread before moving to Requested (and let go of by the worker once Released):
+		std::shared_ptr< std::vector< unsigned char > const > bytes;
+		bool loop = false;
+
+		//--- worker thread only ---
+		OggOpusFile *file = nullptr;
+
+		//set by the worker after it has pushed the last of the decoded data:
+		std::atomic< bool > ended{false};
+
+		//decoded samples (worker produces, audio thread consumes):
+		SPSCRing< float, OpusStream::RingSize > ring;
+	};
+	std::array< Stream, OpusStream::MaxStreams > streams;
+
+	std::thread worker;
+	std::mutex worker_mutex;
+	std::condition_variable worker_cv;
+	bool worker_quit = false; //(protected by worker_mutex)
+
+	//helper: decode as much as fits into a stream's ring; returns true if anything was decoded:
+	bool decode_ahead(Stream &stream) {
+		//reads are generally 960 samples, so this is plenty:
+		constexpr uint32_t const Chunk = 2048;
+		float stereo[2 * Chunk];
+		float mono[Chunk];
+
+		bool decoded = false;
+		while (!stream.ended.load(std::memory_order_relaxed)) {
+			uint32_t space = OpusStream::RingSize - stream.ring.size();
+			if (space == 0) break;
+			uint32_t want = (space < Chunk ? space : Chunk);
+
+			int ret = op_read_float_stereo(stream.file, stereo, int(2 * want));
+			if (ret < 0) {
+				std::cerr << "WARNING: opusfile read error " << ret << " while streaming; stopping stream." << std::endl;
+				stream.ended.store(true, std::memory_order_release);
+				break;
+			}
+			if (ret == 0) {
+				if (stream.loop && op_pcm_seek(stream.file, 0) == 0) continue;
+				stream.ended.store(true, std::memory_order_release);
+				break;
+			}
+			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+				mono[i] = (stereo[2*i] + stereo[2*i+1]) * 0.5f; //downmix to mono by averaging
+			}
+			uint32_t pushed = stream.ring.push_n(mono, uint32_t(ret));
+			assert(pushed == uint32_t(ret)); (void)pushed; //(only the worker pushes, and we checked space)
+			decoded = true;
+		}
+		return decoded;
+	}
+
+	void worker_main() {
+		for (;;) {
+			bool busy = false;
+			for (auto &stream : streams) {
+				uint32_t state = stream.state.load(std::memory_order_acquire);
+				if (state == StreamRequested) {
+					int err = 0;
+					stream.file = op_open_memory(stream.bytes->data(), stream.bytes->size(), &err);
+					if (err != 0 || !stream.file) {
+						std::cerr << "WARNING: opusfile error " << err << " opening stream." << std::endl;
+						stream.file = nullptr;
+						stream.ended.store(true, std::memory_order_release);
+					}
+					//(the owner may have released the stream meanwhile; only move on from Requested)
+					uint32_t expected = StreamRequested;
+					stream.state.compare_exchange_strong(expected, StreamActive, std::memory_order_acq_rel);
+					busy = true;
+				} else if (state == StreamActive) {
+					if (stream.file && decode_ahead(stream)) busy = true;
+				} else if (state == StreamReleased) {
+					//the owner is done reading, so the worker may empty the ring:
+					if (stream.file) {
+						op_free(stream.file);
+						stream.file = nullptr;
+					}
+					stream.bytes.reset();
+					stream.ring.pop_n(nullptr, OpusStream::RingSize);
+					stream.ended.store(false, std::memory_order_relaxed);
+					stream.state.store(StreamFree, std::memory_order_release);
+				}
+			}
+
+			std::unique_lock< std::mutex > lock(worker_mutex);
+			if (worker_quit) break;
+			//rings hold ~340ms of audio, so checking back every few milliseconds is plenty:
+			if (!busy) worker_cv.wait_for(lock, std::chrono::milliseconds(4));
+		}
+
+		//close anything still open:
+		for (auto &stream : streams) {
+			if (stream.file) {
+				op_free(stream.file);
+				stream.file = nullptr;
+			}
+		}
+	}
+}
+
+void OpusStream::start() {
+	assert(!worker.joinable());
+	{
+		std::lock_guard< std::mutex > lock(worker_mutex);
+		worker_quit = false;
+	}
+	worker = std::thread(worker_main);
+}
+
+void OpusStream::stop() {
+	if (!worker.joinable()) return;
+	{
+		std::lock_guard< std::mutex > lock(worker_mutex);
+		worker_quit = true;
+	}
+	worker_cv.notify_one();
+	worker.join();
+	for (auto &stream : streams) {
+		stream.bytes.reset();
+		stream.ring.pop_n(nullptr, RingSize);
+		stream.ended.store(false, std::memory_order_relaxed);
+		stream.state.store(StreamFree, std::memory_order_relaxed);
+	}
+}
+
+uint32_t OpusStream::open(std::shared_ptr< std::vector< unsigned char > const > const &bytes, bool loop) {
+	assert(bytes);
+	for (uint32_t s = 0; s < MaxStreams; ++s) {
+		Stream &stream = streams[s];
+		if (stream.state.load(std::memory_order_acquire) != StreamFree) continue;
+		//(only the game thread moves streams out of Free, so no need for compare-exchange)
+		stream.bytes = bytes;
+		stream.loop = loop;
+		stream.state.store(StreamRequested, std::memory_order_release);
+		worker_cv.notify_one();
+		return s;
+	}
+	return None;
+}
+
+uint32_t OpusStream::read(uint32_t s, float *out, uint32_t count, bool *finished) {
+	assert(s < MaxStreams);
+	assert(finished);
+	Stream &stream = streams[s];
+	//check 'ended' *before* reading, so that a short read really means the ring ran dry:
+	bool ended = stream.ended.load(std::memory_order_acquire);
+	uint32_t got = stream.ring.pop_n(out, count);
+	*finished = (ended && got < count);
+	return got;
+}
+
+void OpusStream::release(uint32_t s) {
+	assert(s < MaxStreams);
+	Stream &stream = streams[s];
+	uint32_t state = stream.state.load(std::memory_order_acquire);
+	while (state == StreamRequested || state == StreamActive) {
+		if (stream.state.compare_exchange_weak(state, StreamReleased, std::memory_order_acq_rel)) break;
+	}
+}
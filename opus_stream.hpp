@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//OpusStream decodes '.opus' data a little ahead of playback, on a worker thread,
+// into small per-stream rings that the audio callback reads from.
+//Used by Sound to play Sound::StreamingSample objects.
+//
+//Streams come from a fixed pool; a stream is opened by the game thread, read and
+// then released by the audio thread, and decoded (and finally closed) by the worker.
+
+namespace OpusStream {
+
+constexpr uint32_t const None = ~0U; //"no stream" value returned by open()
+constexpr uint32_t const MaxStreams = 8; //number of streams that can play at once
+constexpr uint32_t const RingSize = 16384; //decoded samples buffered per stream (~1/3 sec at 48kHz)
+
+//start/stop the decoding worker thread (Sound::init / Sound::shutdown do this):
+void start();
+void stop();
+
+//(game thread) start decoding the opus data in 'bytes' into a free stream.
+// the stream shares ownership of the data until it has been released and cleaned up,
+// so whatever 'bytes' came from may be destroyed while it plays.
+// returns the stream index, or None if all streams are in use:
+uint32_t open(std::shared_ptr< std::vector< unsigned char > const > const &bytes, bool loop);
+
+//(audio thread) read up to 'count' decoded (48kHz mono) samples into 'out'; returns number read.
+// sets *finished once the stream has ended and every decoded sample has been read.
+// (fewer than 'count' samples without *finished means the decoder is behind.)
+uint32_t read(uint32_t stream, float *out, uint32_t count, bool *finished);
+
+//(owner of the stream -- the audio thread, once playing) hand the stream back to the pool:
+void release(uint32_t stream);
+
+} //namespace OpusStream
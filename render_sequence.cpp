@@ -0,0 +1,49 @@
+#include "render_sequence.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+Sound::Sample render_sequence(std::vector< Sound::SequenceItem > const &items, float crossfade) {
+	constexpr float const Rate = 48000.0f;
+	int64_t fade = int64_t(std::round(std::max(0.0f, crossfade) * Rate));
+
+	//lay out the items first, to find out how long the result is:
+	std::vector< int64_t > starts;
+	starts.reserve(items.size());
+	int64_t end = 0; //end of the previous item
+	int64_t length = 0;
+	for (auto const &item : items) {
+		assert(item.sample);
+		int64_t start = end + int64_t(std::round(std::max(0.0f, item.gap) * Rate)) - (starts.empty() ? 0 : fade);
+		if (!starts.empty()) start = std::max(start, starts.back()); //(never start before the previous item)
+		start = std::max< int64_t >(start, 0);
+		starts.emplace_back(start);
+		end = start + int64_t(item.sample->size());
+		length = std::max(length, end);
+	}
+
+	std::vector< float > output(size_t(length), 0.0f);
+	std::vector< float > decoded;
+	for (size_t i = 0; i < items.size(); ++i) {
+		Sound::Sample const &sample = *items[i].sample;
+		decoded.resize(sample.size());
+		sample.decode(0, sample.size(), decoded.data());
+
+		//fade in (except the first item) and out (except the last), over at most half the sample:
+		int64_t size = int64_t(decoded.size());
+		int64_t fade_in = (i == 0 ? 0 : std::min(fade, size / 2));
+		int64_t fade_out = (i + 1 == items.size() ? 0 : std::min(fade, size / 2));
+
+		float *out = output.data() + starts[i];
+		for (int64_t s = 0; s < size; ++s) {
+			float amp = items[i].volume;
+			if (s < fade_in) amp *= float(s + 1) / float(fade_in + 1);
+			if (size - 1 - s < fade_out) amp *= float(size - s) / float(fade_out + 1);
+			out[s] += amp * decoded[size_t(s)];
+		}
+	}
+
+	return Sound::Sample(output);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Sound.hpp"
+
+#include <vector>
+
+//Render a sequence of samples (as would be queued by Sound::schedule_sequence) into one new Sample,
+// so the whole sequence plays as a single voice.
+//
+//Each item starts 'gap' seconds after the previous one ends, less 'crossfade' seconds: the end of each
+// sample fades out while the next one fades in (so back-to-back samples join without clicks).
+//Item volumes are applied; pans are not (the result is mono -- pan it when playing it).
+//Decodes every item, so prefer to run it on a worker thread.
+Sound::Sample render_sequence(std::vector< Sound::SequenceItem > const &items, float crossfade = 0.005f);
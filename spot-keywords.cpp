@@ -0,0 +1,134 @@
+//spot-keywords runs recordings through the same speech input pipeline the game uses for spoken
+// answers (see SpeechInput and KeywordSpotter), and reports what it heard and how fast it was.
+//
+//Usage:
+//  spot-keywords <template1.opus|wav> [template2.opus|wav] [...] -- <speech1.wav|opus> [speech2.wav|opus] [...]
+//
+//Templates are named for what they say: the file name without directory or extension must be a single
+// letter or digit (e.g., "dist/sounds/a.opus"); other files are skipped, so 'dist/sounds/*.opus' works.
+//
+//Speech files are fed through one after another, with half a second of silence around each, in
+// 10ms steps as if they were being recorded. If a speech file's name starts with a template's letter
+// followed by anything other than a letter or digit (e.g., "a.wav" or "a-take2.wav"), what was heard in
+// it is checked against that letter.
+//
+//Prints each decision (with how long after the end of the utterance it came), then:
+//  - how many decisions were right (for files with names to check against)
+//  - the longest time from end of utterance to decision
+//  - the share of one core the pipeline used (must stay well under 100% to keep up in real time)
+
+#include "SpeechInput.hpp"
+#include "load_opus.hpp"
+#include "load_wav.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	try {
+		std::vector< std::string > template_files, speech_files;
+		bool after_separator = false;
+		for (int argi = 1; argi < argc; ++argi) {
+			std::string arg = argv[argi];
+			if (arg == "--" && !after_separator) {
+				after_separator = true;
+			} else if (after_separator) {
+				speech_files.emplace_back(arg);
+			} else {
+				template_files.emplace_back(arg);
+			}
+		}
+		if (template_files.empty() || speech_files.empty()) {
+			std::cerr << "Usage:\n\t" << argv[0] << " <template1.opus|wav> [template2.opus|wav] [...] -- <speech1.wav|opus> [speech2.wav|opus] [...]" << std::endl;
+			return 1;
+		}
+
+		//file name without directory or extension:
+		auto base_name = [](std::string const &path) {
+			std::string name = path.substr(path.find_last_of("/\\") + 1);
+			return name.substr(0, name.rfind('.'));
+		};
+
+		SpeechInput input(speech_files);
+
+		std::string letters;
+		std::vector< float > data;
+		for (auto const &file : template_files) {
+			std::string name = base_name(file);
+			if (name.size() != 1 || !std::isalnum(static_cast< unsigned char >(name[0]))) {
+				std::cout << "(skipping '" << file << "' -- not named for a single letter or digit)" << std::endl;
+				continue;
+			}
+			if (file.size() >= 4 && file.substr(file.size()-4) == ".wav") {
+				load_wav(file, &data);
+			} else {
+				load_opus(file, &data);
+			}
+			input.spotter.add_template(name[0], data);
+			letters += name[0];
+		}
+		std::cout << input.spotter.templates.size() << " templates." << std::endl;
+
+		//what each speech file should be heard as ('\0' if unknown):
+		std::vector< char > expected;
+		for (auto const &file : speech_files) {
+			std::string name = base_name(file);
+			bool named = !name.empty() && letters.find(name[0]) != std::string::npos
+				&& (name.size() == 1 || !std::isalnum(static_cast< unsigned char >(name[1])));
+			expected.emplace_back(named ? name[0] : '\0');
+		}
+
+		float const Rate = float(KeywordSpotter::Rate);
+		uint32_t checked = 0, correct = 0;
+		float max_latency = 0.0f;
+		while (!input.done()) {
+			input.update(float(KeywordSpotter::Hop) / Rate);
+			KeywordSpotter::Result result;
+			while (input.spotter.poll(&result)) {
+				//which file was this in? (the one it overlaps most)
+				size_t file = 0;
+				size_t best_overlap = 0;
+				for (size_t f = 0; f < input.file_ranges.size(); ++f) {
+					size_t begin = std::max< size_t >(input.file_ranges[f].first, result.begin_sample);
+					size_t end = std::min< size_t >(input.file_ranges[f].second, result.end_sample);
+					if (end > begin && end - begin > best_overlap) {
+						best_overlap = end - begin;
+						file = f;
+					}
+				}
+
+				float latency = float(result.decided_sample - result.end_sample) / Rate;
+				max_latency = std::max(max_latency, latency);
+				std::cout << std::fixed << std::setprecision(2) << result.begin_sample / Rate << "s - " << result.end_sample / Rate << "s";
+				if (best_overlap) std::cout << " (" << speech_files[file] << ")";
+				std::cout << ": heard '" << (result.letter ? std::string(1, result.letter) : std::string("?")) << "'"
+				          << " at distance " << result.distance
+				          << ", decided " << std::setprecision(0) << latency * 1000.0f << "ms after it ended";
+				if (best_overlap && expected[file]) {
+					++checked;
+					if (result.letter == expected[file]) {
+						++correct;
+					} else {
+						std::cout << " -- WRONG, should be '" << expected[file] << "'";
+					}
+				}
+				std::cout << std::endl;
+			}
+		}
+
+		double audio_seconds = double(input.spotter.samples_fed) / double(KeywordSpotter::Rate);
+		std::cout << correct << " of " << checked << " checked decisions right." << std::endl;
+		std::cout << "Longest wait from end of utterance to decision: " << std::setprecision(0) << max_latency * 1000.0f << "ms." << std::endl;
+		std::cout << "Pipeline used " << std::setprecision(2) << 100.0 * input.spotter.busy_seconds / audio_seconds << "% of one core ("
+		          << input.spotter.frames_analyzed << " frames over " << audio_seconds << "s of audio)." << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "spot-keywords failed:\n" << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
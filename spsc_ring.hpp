@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+//SPSCRing<> is a fixed-capacity, lock-free, single-producer / single-consumer queue.
+// Exactly one thread may call push() and exactly one (other) thread may call pop().
+// Neither call ever blocks or allocates, which makes it safe to use from the audio callback.
+//
+//Capacity must be a power of two.
+
+template< typename T, uint32_t Capacity >
+struct SPSCRing {
+	static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	//(producer) add a value to the back of the queue; returns false (and leaves value alone) if full:
+	bool push(T const &value) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+		slots[t & (Capacity - 1)] = value;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	//(consumer) remove the value at the front of the queue; returns false if empty:
+	// (the slot is moved-from, so it doesn't keep resources alive)
+	bool pop(T *value) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		*value = std::move(slots[h & (Capacity - 1)]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	//(producer) bulk version of push; adds as many of 'count' values as fit and returns how many that was:
+	uint32_t push_n(T const *values, uint32_t count) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t space = Capacity - (t - head.load(std::memory_order_acquire));
+		count = (count < space ? count : space);
+		//(copied as at most two contiguous runs -- up to the end of 'slots', then from the start -- so the copies vectorize)
+		uint32_t at = t & (Capacity - 1);
+		uint32_t first = (count < Capacity - at ? count : Capacity - at);
+		std::copy(values, values + first, slots.begin() + at);
+		std::copy(values + first, values + count, slots.begin());
+		tail.store(t + count, std::memory_order_release);
+		return count;
+	}
+
+	//(consumer) bulk version of pop; removes up to 'count' values and returns how many were removed:
+	// (if 'values' is null, the values are just discarded)
+	uint32_t pop_n(T *values, uint32_t count) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		uint32_t available = tail.load(std::memory_order_acquire) - h;
+		count = (count < available ? count : available);
+		if (values) {
+			uint32_t at = h & (Capacity - 1);
+			uint32_t first = (count < Capacity - at ? count : Capacity - at);
+			std::move(slots.begin() + at, slots.begin() + at + first, values);
+			std::move(slots.begin(), slots.begin() + (count - first), values + first);
+		}
+		head.store(h + count, std::memory_order_release);
+		return count;
+	}
+
+	//approximate number of queued values (exact when called by producer or consumer while the other is idle):
+	uint32_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	std::array< T, Capacity > slots;
+	//head and tail are padded onto their own cache lines so producer and consumer don't false-share:
+	// (padding instead of alignas() because MSVC warns about over-aligned structures)
+	char pad_slots[64];
+	std::atomic< uint32_t > head{0}; //next slot to read (written by consumer)
+	char pad_head[64 - sizeof(std::atomic< uint32_t >)];
+	std::atomic< uint32_t > tail{0}; //next slot to write (written by producer)
+	char pad_tail[64 - sizeof(std::atomic< uint32_t >)];
+};
@@ -0,0 +1,90 @@
+#include "time_stretch.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace {
+	//grain size and output hop (at 48kHz: ~21ms grains, 50% overlap):
+	constexpr uint32_t const Grain = 1024;
+	constexpr uint32_t const Hop = Grain / 2;
+	//how far (in samples) a grain may be moved from its nominal position to line up with the previous one:
+	constexpr int32_t const Tolerance = 256;
+	//the search is done coarsely first, then refined around the best coarse offset:
+	constexpr int32_t const CoarseStep = 4;
+
+	//similarity of a[0..Hop) and b[0..Hop), checking every other sample (plenty for lining up waveforms):
+	float similarity(float const *a, float const *b) {
+		float sum = 0.0f;
+		for (uint32_t i = 0; i < Hop; i += 2) {
+			sum += a[i] * b[i];
+		}
+		return sum;
+	}
+}
+
+Sound::Sample time_stretch(Sound::Sample const &sample, float speed) {
+	assert(speed > 0.0f);
+
+	//decode input (it may be strided or compressed) with Tolerance + Grain of zeros on either side,
+	// so grains near the ends can be read without bounds checks:
+	constexpr uint32_t const Pad = uint32_t(Tolerance) + Grain;
+	std::vector< float > input(Pad + sample.size() + Pad, 0.0f);
+	sample.decode(0, sample.size(), input.data() + Pad);
+
+	size_t out_size = size_t(std::round(double(sample.size()) / speed));
+	if (out_size == 0) return Sound::Sample(std::vector< float >());
+
+	//Hann window; with 50% overlap the windows sum to one:
+	std::vector< float > window(Grain);
+	for (uint32_t i = 0; i < Grain; ++i) {
+		window[i] = 0.5f - 0.5f * std::cos(2.0f * 3.14159265f * float(i) / float(Grain));
+	}
+
+	std::vector< float > output(out_size + Grain, 0.0f);
+
+	//'previous' is where (in 'input') the last grain came from:
+	size_t previous = Pad;
+	for (size_t out_at = 0; out_at < out_size; out_at += Hop) {
+		//where this grain would come from with no adjustment:
+		size_t nominal = Pad + size_t(std::round(double(out_at) * speed));
+		nominal = std::min(nominal, input.size() - Pad);
+
+		size_t best = nominal;
+		if (out_at != 0) {
+			//the input that naturally follows the previous grain -- the new grain should look like this:
+			float const *target = input.data() + previous + Hop;
+			float best_score = -INFINITY;
+			auto consider = [&](int32_t offset) {
+				size_t at = size_t(int64_t(nominal) + offset);
+				float score = similarity(input.data() + at, target);
+				if (score > best_score) {
+					best_score = score;
+					best = at;
+				}
+			};
+			for (int32_t offset = -Tolerance; offset <= Tolerance; offset += CoarseStep) {
+				consider(offset);
+			}
+			int32_t coarse = int32_t(int64_t(best) - int64_t(nominal));
+			for (int32_t offset = std::max(-Tolerance, coarse - CoarseStep + 1); offset <= std::min(Tolerance, coarse + CoarseStep - 1); ++offset) {
+				if (offset != coarse) consider(offset);
+			}
+		}
+
+		for (uint32_t i = 0; i < Grain; ++i) {
+			output[out_at + i] += window[i] * input[best + i];
+		}
+		previous = best;
+	}
+
+	//the first half-grain only got one (rising) window; undo that so the attack isn't faded in:
+	for (uint32_t i = 0; i < Hop && i < out_size; ++i) {
+		if (window[i] > 1e-3f) output[i] /= window[i];
+	}
+
+	output.resize(out_size);
+	return Sound::Sample(output, sample.encoding);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Sound.hpp"
+
+//Change how long a Sample lasts without changing its pitch, using WSOLA
+// (waveform-similarity overlap-add: the output is built from overlapping, windowed grains of the input,
+//  each taken from near where it "should" come from, nudged to line up with the previous grain's waveform).
+//
+//'speed' > 1.0 makes the result shorter (e.g., 2.0 == half as long); returns a new Sample (in the same encoding).
+//Takes a few milliseconds per second of audio, so prefer to run it on a worker thread.
+Sound::Sample time_stretch(Sound::Sample const &sample, float speed);